@@ -27,6 +27,27 @@
 #include "config.h"
 #include "stree.h"
 
+/* Entry points past those of malloc are optional: a backend that leaves
+ * one out still links, and the driver checks for it before use */
+#pragma weak mm_malloc_batch
+#pragma weak mm_free_batch
+#pragma weak mm_free_sized
+#pragma weak mm_memalign
+#pragma weak mm_usable_size
+#pragma weak mm_pool_create
+#pragma weak mm_pool_alloc
+#pragma weak mm_pool_free
+#pragma weak mm_pool_destroy
+#pragma weak mm_arena_create
+#pragma weak mm_arena_alloc
+#pragma weak mm_arena_reset
+#pragma weak mm_arena_destroy
+#pragma weak mm_halloc
+#pragma weak mm_hlock
+#pragma weak mm_hunlock
+#pragma weak mm_hfree
+#pragma weak mm_hcompact
+
 /**********************
  * Constants and macros
  **********************/
@@ -80,9 +101,11 @@ typedef struct {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, ALLOC_BATCH, FREE_BATCH, MEMALIGN, CALLOC } type; /* type of request */
     long index;                         /* index for free() to use later */
     size_t size;                        /* byte size of alloc/realloc request */
+    int count;                          /* ids index..index+count-1 for batches */
+    size_t align;                       /* alignment of a memalign request */
 } traceop_t;
 
 /* Holds the information for one trace file */
@@ -95,6 +118,10 @@ typedef struct {
     traceop_t *ops;       /* array of requests */
     char **blocks;        /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
+    mm_pool_t **block_pools; /* ... and, with -P, the pool of each, or NULL */
+    mm_handle_t **block_handles; /* ... and, with -H, the handle of each, or NULL */
+    mm_arena_t **batch_arenas; /* with -E, the arena of each batch, at its first id */
+    bool batches_paired;  /* each batch free matches one batch allocation */
     int *block_rand_base; /* index into random_data, if debug is on */
 } trace_t;
 
@@ -108,6 +135,15 @@ typedef struct {
     range_set_t *ranges;
 } speed_t;
 
+/* Totals over the compactions of a run with -H */
+typedef struct {
+    int count;         /* number of compactions */
+    size_t live;       /* payload bytes allocated at each, summed */
+    size_t before;     /* heap plus mapped bytes just before each, summed */
+    size_t after;      /* ... and just after each */
+    size_t moved;      /* bytes mem_memcpy/mem_memmove copied during them */
+} compact_stats_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -121,6 +157,14 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
+    int reallocs;      /* number of realloc requests in the trace */
+    int fit_reallocs;  /* reallocs that fit in mm_usable_size in the util run */
+    size_t copied;     /* bytes moved by mem_memcpy/mem_memmove in the util run */
+    size_t peak_heapsize; /* largest heap plus mapped size during the util run */
+    size_t heapsize;   /* heap plus mapped size at the end of the util run */
+    size_t released;   /* bytes of pages released by shrinking in the util run */
+    size_t sbrks;      /* mem_sbrk calls that grew the heap in the util run */
+    compact_stats_t compact; /* with -H, the compactions of the util run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -143,6 +187,17 @@ typedef struct {
  *******************/
 #define RANDOM_DATA_LEN (1<<16)
 
+/* With -P, plain requests of up to this many bytes are served by pools */
+#define POOL_MAX_BYTES 1024
+
+/* With -E, at most this many reset arenas are kept for later batches */
+#define MAX_SPARE_ARENAS 64
+
+/* With -H, a trace is compacted about this many times, each after a free,
+   by mm_hcompact calls with a budget of COMPACT_STEP bytes */
+#define COMPACT_POINTS 16
+#define COMPACT_STEP (1<<14)
+
 typedef unsigned char randint_t;
 static const char randint_t_name[] = "byte";
 static randint_t random_data[RANDOM_DATA_LEN];
@@ -170,6 +225,42 @@ static int set_timeout = 0;
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* If set (-B), comma-separated list of name prefixes selecting which
+   default tracefiles to benchmark */
+static char *bench_prefixes = NULL;
+
+/* If set (-R), print bytes copied and heap sizes for each trace */
+static bool realloc_report = false;
+
+/* If set (-U), replay batch requests as single mm_malloc/mm_free calls */
+static bool unbatch = false;
+
+/* If set (-S), replay frees as mm_free_sized with the block's size */
+static bool sized_free = false;
+
+/* If set (-P), replay plain allocations of up to POOL_MAX_BYTES from one
+   mm_pool per request size (pools[size]), destroyed at the end of a run */
+static bool pooled = false;
+static mm_pool_t *pools[POOL_MAX_BYTES + 1];
+
+/* If set (-E), replay each batch request as one phase in an arena: its
+   blocks come from mm_arena_alloc, and freeing the batch resets the arena
+   and keeps it for a later batch. Arenas are destroyed at the end of a run */
+static bool arenas = false;
+static mm_arena_t *spare_arenas[MAX_SPARE_ARENAS];
+static int num_spare_arenas = 0;
+
+/* If set (-H), replay plain allocations as objects behind mm_halloc
+   handles, kept locked except while the trace is compacted (see
+   mm_compact), and report utilization before and after compacting */
+static bool handles = false;
+
+/* Compactions in the last eval_mm_util run */
+static compact_stats_t util_compact;
+
+/* Reallocs in the last eval_mm_util run that fit in the usable size */
+static int util_fit_reallocs = 0;
+
 /* The following are null-terminated lists of tracefiles that may or may not get used */
 
 /* The filenames of the default tracefiles */
@@ -200,6 +291,7 @@ static sum_stats_t global_mm_sum_stats;
 
 /* This function enables generating the set of trace files */
 static void add_tracefile(char *trace);
+static bool bench_selected(const char *trace);
 
 /* these functions manipulate range sets */
 static range_set_t *new_range_set();
@@ -212,12 +304,14 @@ static void free_range_set(range_set_t *ranges);
 static void init_random_data(void);
 static bool check_index(const trace_t *trace, int opnum, int index);
 static void randomize_block(trace_t *trace, int index);
+static bool check_zero(const trace_t *trace, int opnum, int index);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
+static bool check_batches(const trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static bool eval_libc_valid(trace_t *trace);
@@ -228,9 +322,20 @@ static void eval_libc_speed(void *ptr);
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
 static void eval_mm_speed(void *ptr);
+static bool mm_alloc_batch(trace_t *trace, const traceop_t *op);
+static void mm_release_batch(trace_t *trace, const traceop_t *op);
+static void mm_release(trace_t *trace, int index);
+static char *mm_acquire(trace_t *trace, int index, size_t size);
+static char *mm_resize(trace_t *trace, int index, size_t size);
+static void mm_destroy_pools(void);
+static void mm_destroy_arenas(trace_t *trace);
+static bool compact_due(const trace_t *trace, int opnum, int *last);
+static bool mm_compact(trace_t *trace, range_set_t *ranges, int opnum);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void print_realloc_report(int n, stats_t *stats);
+static void print_compact_report(int n, stats_t *stats);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -272,7 +377,6 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         trace_t *trace;
         trace = read_trace(&mm_stats[i], tracedir, tracefiles[i]);
         strcpy(mm_stats[i].filename, trace->filename);
-        mm_stats[i].ops = trace->num_ops;
 
         /* Prepare for timeout */
         if (setjmp(timeout_jmpbuf) != 0) {
@@ -290,9 +394,21 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             }
         }
         if (mm_stats[i].valid) {
+            int op;
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].copied = mem_bytes_copied();
+            mm_stats[i].peak_heapsize = mem_peak_footprint();
+            mm_stats[i].heapsize = mem_heapsize() + mem_mapped_bytes();
+            mm_stats[i].released = mem_bytes_released();
+            mm_stats[i].sbrks = mem_sbrk_calls();
+            mm_stats[i].fit_reallocs = util_fit_reallocs;
+            mm_stats[i].compact = util_compact;
+            mm_stats[i].reallocs = 0;
+            for (op = 0; op < trace->num_ops; op++)
+                if (trace->ops[op].type == REALLOC)
+                    mm_stats[i].reallocs++;
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
@@ -353,7 +469,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpOVAlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:B:hpOVAlDTRUSPEH")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -382,6 +498,10 @@ int main(int argc, char **argv)
                 strcat(tracedir, "/"); /* path always ends with "/" */
             break;
 
+        case 'B': /* Benchmark a subset of the default traces */
+            bench_prefixes = optarg;
+            break;
+
         case 'l': /* Run libc malloc */
             run_libc = true;
             break;
@@ -410,6 +530,38 @@ int main(int argc, char **argv)
             tab_mode = true;
             break;
 
+        case 'R': /* Report realloc copying and heap size */
+            realloc_report = true;
+            break;
+
+        case 'U': /* Replay batch requests one block at a time */
+            unbatch = true;
+            break;
+
+        case 'S': /* Replay frees with the size of the block */
+            if (mm_free_sized == NULL)
+                app_error("-S: the allocator has no mm_free_sized\n");
+            sized_free = true;
+            break;
+
+        case 'P': /* Replay small plain requests from per-size pools */
+            if (mm_pool_create == NULL)
+                app_error("-P: the allocator has no mm_pool_create\n");
+            pooled = true;
+            break;
+
+        case 'E': /* Replay each batch request in an arena */
+            if (mm_arena_create == NULL)
+                app_error("-E: the allocator has no mm_arena_create\n");
+            arenas = true;
+            break;
+
+        case 'H': /* Replay plain requests through handles and compact */
+            if (mm_halloc == NULL)
+                app_error("-H: the allocator has no mm_halloc\n");
+            handles = true;
+            break;
+
         case 'h': /* Print this message */
             usage(argv[0]);
             exit(0);
@@ -425,10 +577,14 @@ int main(int argc, char **argv)
         int i;
         if (sparse_mode & !run_libc) {
             for (i = 0; default_giant_tracefiles[i]; i++)
-                add_tracefile(default_giant_tracefiles[i]);
+                if (bench_selected(default_giant_tracefiles[i]))
+                    add_tracefile(default_giant_tracefiles[i]);
         }
         for (i = 0; default_tracefiles[i]; i++)
-            add_tracefile(default_tracefiles[i]);
+            if (bench_selected(default_tracefiles[i]))
+                add_tracefile(default_tracefiles[i]);
+        if (num_global_tracefiles == 0)
+            app_error("No default tracefile matches -B %s\n", bench_prefixes);
     }
 
     if (debug_mode != DBG_NONE) {
@@ -523,6 +679,10 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (realloc_report)
+                print_realloc_report(num_global_tracefiles, mm_stats);
+            if (handles)
+                print_compact_report(num_global_tracefiles, mm_stats);
         }
     }
 
@@ -680,6 +840,26 @@ static void add_tracefile(char *trace) {
     global_tracefiles[num_global_tracefiles++] = strdup(trace);
 }
 
+/*
+ * bench_selected - true if the default tracefile trace should be run,
+ *     i.e. -B was not given or trace begins with one of its prefixes.
+ */
+static bool bench_selected(const char *trace) {
+    const char *prefix = bench_prefixes;
+
+    if (prefix == NULL)
+        return true;
+    while (*prefix) {
+        size_t len = strcspn(prefix, ",");
+        if (len > 0 && strncmp(trace, prefix, len) == 0)
+            return true;
+        prefix += len;
+        if (*prefix == ',')
+            prefix++;
+    }
+    return false;
+}
+
 
 
 /*****************************************************************
@@ -710,18 +890,34 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
 
     assert(size > 0);
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
+    /* Payload addresses must be ALIGNMENT-byte aligned. A pool slot only
+       needs the alignment of a type of its size: 8 unless the size is a
+       multiple of ALIGNMENT */
+    size_t align = ALIGNMENT;
+    if (trace->block_pools[index] != NULL && size % ALIGNMENT != 0)
+        align = sizeof(void *);
+    if (((unsigned long)lo) % align != 0) {
+        malloc_error(trace, opnum,
+                     "Payload address (%p) not aligned to %zu bytes", lo, align);
+        return false;
+    }
+
+    /* ... and memalign payloads to the alignment asked for */
+    if (trace->ops[opnum].type == MEMALIGN &&
+        ((unsigned long)lo) % trace->ops[opnum].align != 0) {
         malloc_error(trace, opnum,
-                     "Payload address (%p) not aligned to %d bytes", lo, ALIGNMENT);
+                     "Payload address (%p) not aligned to %zu bytes",
+                     lo, trace->ops[opnum].align);
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       one region from mem_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_in_region(lo, size)) {
         malloc_error(trace, opnum,
-                     "Payload (%p:%p) lies outside heap (%p:%p)",
+                     "Payload (%p:%p) lies outside heap (%p:%p) and any mapped region",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return false;
     }
@@ -842,6 +1038,30 @@ static void randomize_block(trace_t *traces, int index) {
     }
 }
 
+/*
+ * check_zero - checks that the payload calloc returned for index reads as
+ *     zero: all of it, or its first maxfill words in sparse mode.
+ */
+static bool check_zero(const trace_t *trace, int opnum, int index) {
+    unsigned char *block = (unsigned char *)trace->blocks[index];
+    size_t size = trace->block_sizes[index];
+    size_t i;
+
+    if (sparse_mode && size > maxfill * sizeof(randint_t))
+        size = maxfill * sizeof(randint_t);
+    for (i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        if (mem_read(block + i, sizeof(uint64_t)) != 0)
+            break;
+    for (; i < size; i++) {
+        if (mem_read(block + i, 1) != 0) {
+            malloc_error(trace, opnum, "calloc block %d (at %p) is not zero "
+                         "at byte %zu", index, block, i);
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool check_index(const trace_t *trace, int opnum, int index) {
     size_t size, fsize;
     size_t i;
@@ -898,6 +1118,9 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     size_t size;
     int max_index = 0;
     int op_index;
+    int count;
+    size_t align;
+    double total_ops = 0;
     int ignore = 0;
 
     if (verbose > 1)
@@ -939,6 +1162,21 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          (size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
         unix_error("malloc 4 failed in read_trace");
 
+    /* ... and the pool each one came from, with -P */
+    if ((trace->block_pools =
+         calloc(trace->num_ids, sizeof(*trace->block_pools))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
+    /* ... and the arena of each batch, with -E */
+    if ((trace->batch_arenas =
+         calloc(trace->num_ids, sizeof(*trace->batch_arenas))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
+    /* ... and the handle of each block, with -H */
+    if ((trace->block_handles =
+         calloc(trace->num_ids, sizeof(*trace->block_handles))) == NULL)
+        unix_error("malloc 4 failed in read_trace");
+
     /* and, if we're debugging, the offset into the random data */
     if ((trace->block_rand_base =
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
@@ -957,6 +1195,13 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'c':
+            ignore += fscanf(tracefile, "%u %lu", &index, &size);
+            trace->ops[op_index].type = CALLOC;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
         case 'r':
             ignore += fscanf(tracefile, "%u %lu", &index, &size);
             trace->ops[op_index].type = REALLOC;
@@ -969,10 +1214,47 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
             trace->ops[op_index].type = FREE;
             trace->ops[op_index].index = index;
             break;
+        case 'm':
+            ignore += fscanf(tracefile, "%u %lu %lu", &index, &align, &size);
+            if (align == 0 || (align & (align - 1)) != 0)
+                app_error("Alignment %lu is not a power of two in tracefile %s\n",
+                          align, trace->filename);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].align = align;
+            trace->ops[op_index].size = size;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'A':
+            ignore += fscanf(tracefile, "%u %u %lu", &index, &count, &size);
+            if (count < 1)
+                app_error("Batch of %d blocks in tracefile %s\n",
+                          count, trace->filename);
+            trace->ops[op_index].type = ALLOC_BATCH;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].count = count;
+            trace->ops[op_index].size = size;
+            max_index = (index + count - 1 > max_index) ?
+                index + count - 1 : max_index;
+            break;
+        case 'F':
+            ignore += fscanf(tracefile, "%u %u", &index, &count);
+            if (count < 1)
+                app_error("Batch of %d blocks in tracefile %s\n",
+                          count, trace->filename);
+            trace->ops[op_index].type = FREE_BATCH;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].count = count;
+            break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
         }
+        if (trace->ops[op_index].type == ALLOC_BATCH ||
+            trace->ops[op_index].type == FREE_BATCH)
+            total_ops += trace->ops[op_index].count;
+        else
+            total_ops += 1;
         op_index++;
         if (op_index == trace->num_ops) break;
     }
@@ -980,14 +1262,77 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
 
+    trace->batches_paired = check_batches(trace);
+    if (arenas && !trace->batches_paired)
+        fprintf(stderr, "Warning: batch frees in %s do not match its batch "
+                "allocations, so -E replays them without arenas\n",
+                trace->filename);
+
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
     stats->weight = trace->weight;
-    stats->ops = trace->num_ops;
+    stats->ops = total_ops; /* a batch counts one op per block */
 
     return trace;
 }
 
+/*
+ * check_batches - Returns whether every batch free in the trace names
+ *     exactly the ids of one live batch allocation, and no other request
+ *     touches an id of a live batch. Only then can -E free a batch by
+ *     resetting its arena.
+ */
+static bool check_batches(const trace_t *trace)
+{
+    int *batch_of; /* first id of the live batch holding each id, or -1 */
+    bool paired = true;
+    int i, j;
+
+    if ((batch_of = malloc(trace->num_ids * sizeof(int))) == NULL)
+        unix_error("malloc failed in check_batches");
+    for (i = 0; i < trace->num_ids; i++)
+        batch_of[i] = -1;
+
+    for (i = 0; paired && i < trace->num_ops; i++) {
+        const traceop_t *op = &trace->ops[i];
+        int last = op->index + op->count - 1;
+        /* Ids outside the trace's range, as in "f -1", are in no batch */
+        if (op->index < 0 || op->index >= trace->num_ids) {
+            if (op->type == ALLOC_BATCH || op->type == FREE_BATCH)
+                paired = false;
+            continue;
+        }
+        switch (op->type) {
+        case ALLOC_BATCH:
+            for (j = op->index; j <= last; j++) {
+                if (batch_of[j] != -1)
+                    paired = false;
+                batch_of[j] = op->index;
+            }
+            break;
+        case FREE_BATCH:
+            /* A batch's ids are contiguous, so its ends pin it down */
+            if (last >= trace->num_ids || batch_of[op->index] != op->index
+                || batch_of[last] != op->index
+                || (last + 1 < trace->num_ids
+                    && batch_of[last + 1] == op->index)) {
+                paired = false;
+                break;
+            }
+            for (j = op->index; j <= last; j++)
+                batch_of[j] = -1;
+            break;
+        default:
+            if (batch_of[op->index] != -1)
+                paired = false;
+            break;
+        }
+    }
+
+    free(batch_of);
+    return paired;
+}
+
 /*
  * reinit_trace - get the trace ready for another run.
  */
@@ -995,6 +1340,12 @@ static void reinit_trace(trace_t *trace)
 {
     memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
     memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
+    memset(trace->block_pools, 0, trace->num_ids * sizeof(*trace->block_pools));
+    memset(trace->batch_arenas, 0, trace->num_ids * sizeof(*trace->batch_arenas));
+    memset(trace->block_handles, 0, trace->num_ids * sizeof(*trace->block_handles));
+    /* Pools and arenas left by a run that stopped early went with its heap */
+    memset(pools, 0, sizeof(pools));
+    num_spare_arenas = 0;
     /* block_rand_base is unused if size is zero */
 }
 
@@ -1007,6 +1358,9 @@ static void free_trace(trace_t *trace)
     free(trace->ops);         /* free the three arrays... */
     free(trace->blocks);
     free(trace->block_sizes);
+    free(trace->block_pools);
+    free(trace->batch_arenas);
+    free(trace->block_handles);
     free(trace->block_rand_base);
     free(trace);              /* and the trace record itself... */
 }
@@ -1021,13 +1375,14 @@ static void free_trace(trace_t *trace)
  */
 static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 {
-    int i;
+    int i, j;
     int index;
     size_t size;
     char *newp;
     char *oldp;
     char *p;
     bool allCheck = true;
+    int last_compact = 0;
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -1067,9 +1422,21 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if (trace->ops[i].type == MEMALIGN && mm_memalign == NULL) {
+                malloc_error(trace, i, "mm_memalign is not defined.");
+                return false;
+            }
+            if (trace->ops[i].type == MEMALIGN)
+                p = mm_memalign(trace->ops[i].align, size);
+            else if (trace->ops[i].type == CALLOC)
+                p = mm_calloc(1, size);
+            else
+                p = mm_acquire(trace, index, size);
+            if (p == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return false;
             }
@@ -1086,6 +1453,10 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
 
+            /* A calloc payload must read as zero */
+            if (trace->ops[i].type == CALLOC && !check_zero(trace, i, index))
+                return false;
+
             /* Set to random data, for debugging. */
             randomize_block(trace, index);
             break;
@@ -1098,7 +1469,7 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 
             /* Call the student's realloc */
             oldp = trace->blocks[index];
-            newp = mm_realloc(oldp, size);
+            newp = mm_resize(trace, index, size);
             if ( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
                 return false;
@@ -1145,17 +1516,53 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 
             /* Remove region from list and call student's free function */
             if (index == -1) {
-                p = 0;
+                mm_free(0);
             } else {
-                p = trace->blocks[index];
-                remove_range(ranges, p);
+                remove_range(ranges, trace->blocks[index]);
+                mm_release(trace, index);
             }
-            mm_free(p);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            if (!mm_alloc_batch(trace, &trace->ops[i])) {
+                malloc_error(trace, i, "mm_malloc_batch failed.");
+                return false;
+            }
+            for (j = 0; j < trace->ops[i].count; j++) {
+                p = trace->blocks[index + j];
+                if (add_range(ranges, p, size, trace, i, index + j) == 0)
+                    return false;
+                trace->block_sizes[index + j] = size;
+                randomize_block(trace, index + j);
+            }
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            for (j = 0; j < trace->ops[i].count; j++) {
+                if (!check_index(trace, i, index + j))
+                {
+                    allCheck = false;
+                }
+                remove_range(ranges, trace->blocks[index + j]);
+            }
+            mm_release_batch(trace, &trace->ops[i]);
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
+
+        /* With -H, compact the heap now and then, after a free */
+        if (compact_due(trace, i, &last_compact) &&
+            !mm_compact(trace, ranges, i))
+            return false;
+    }
+    mm_destroy_pools();
+    mm_destroy_arenas(trace);
+    if ((pooled || arenas) && !mm_checkheap(0)) {
+        malloc_error(trace, trace->num_ops - 1,
+                     "mm_checkheap returned false after destroying pools");
+        return false;
     }
     /* As far as we know, this is a valid malloc package */
     return allCheck;
@@ -1166,24 +1573,29 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap plus the regions from mem_map in bytes
+ *   while running the student's malloc package on the trace. mem_sbrk()
+ *   lets the package shrink the heap and regions can be unmapped, so
+ *   the final footprint can lie below this peak.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
-    int i;
+    int i, j;
     int index;
     size_t size, newsize, oldsize;
     size_t max_total_size = 0;
     size_t total_size = 0;
+    size_t usable;
     char *p;
     char *newp, *oldp;
+    int last_compact = 0;
+    size_t heapsize, copied;
 
     reinit_trace(trace);
+    util_fit_reallocs = 0;
+    memset(&util_compact, 0, sizeof(util_compact));
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
@@ -1194,10 +1606,18 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if (trace->ops[i].type == MEMALIGN)
+                p = mm_memalign(trace->ops[i].align, size);
+            else if (trace->ops[i].type == CALLOC)
+                p = mm_calloc(1, size);
+            else
+                p = mm_acquire(trace, index, size);
+            if (p == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1215,11 +1635,18 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+            usable = trace->block_pools[index] || mm_usable_size == NULL
+                ? 0 : mm_usable_size(oldp);
+            if ((newp = mm_resize(trace, index, newsize)) == NULL
+                && newsize != 0) {
                 app_error("trace %d: mm_realloc failed in eval_mm_util",
                           tracenum);
             }
 
+            /* Satisfied for free: same block, and no bigger than it was */
+            if (newp == oldp && newsize != 0 && newsize <= usable)
+                util_fit_reallocs++;
+
             /* Remember region and size */
             trace->blocks[index] = newp;
             trace->block_sizes[index] = newsize;
@@ -1231,17 +1658,37 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             index = trace->ops[i].index;
             if (index < 0) {
                 size = 0;
-                p = 0;
+                mm_free(0);
             } else {
                 size = trace->block_sizes[index];
-                p = trace->blocks[index];
+                mm_release(trace, index);
             }
 
-            mm_free(p);
-
             total_size -= size;
             break;
 
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+
+            if (!mm_alloc_batch(trace, &trace->ops[i])) {
+                app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                          tracenum);
+            }
+            for (j = 0; j < trace->ops[i].count; j++)
+                trace->block_sizes[index + j] = size;
+
+            total_size += size * trace->ops[i].count;
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            index = trace->ops[i].index;
+            for (j = 0; j < trace->ops[i].count; j++)
+                total_size -= trace->block_sizes[index + j];
+
+            mm_release_batch(trace, &trace->ops[i]);
+            break;
+
         default:
             app_error("trace %d: Nonexistent request type in eval_mm_util",
                       tracenum);
@@ -1250,13 +1697,28 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
+
+        /* With -H, compact now and then, and measure the heap around it */
+        if (compact_due(trace, i, &last_compact)) {
+            heapsize = mem_heapsize() + mem_mapped_bytes();
+            copied = mem_bytes_copied();
+            mm_compact(trace, NULL, i);
+            util_compact.count++;
+            util_compact.live += total_size;
+            util_compact.before += heapsize;
+            util_compact.after += mem_heapsize() + mem_mapped_bytes();
+            util_compact.moved += mem_bytes_copied() - copied;
+        }
     }
 
+    mm_destroy_pools();
+    mm_destroy_arenas(trace);
+
 #if !REF_ONLY
     printf(".");
 #endif
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -1268,7 +1730,8 @@ static void eval_mm_speed(void *ptr)
 {
     int i, index;
     size_t size, newsize;
-    char *p, *newp, *oldp, *block;
+    char *p, *newp;
+    int last_compact = 0;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
 
@@ -1278,39 +1741,77 @@ static void eval_mm_speed(void *ptr)
         app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_acquire(trace, index, size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
+            if (sized_free || pooled || handles)
+                trace->block_sizes[index] = size;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            if (sized_free)
+                trace->block_sizes[index] = size;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(1, size)) == NULL)
+                app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            if (sized_free)
+                trace->block_sizes[index] = size;
             break;
 
         case REALLOC: /* mm_realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
-            oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+            if ((newp = mm_resize(trace, index, newsize)) == NULL
+                && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
+            if (sized_free || pooled || handles)
+                trace->block_sizes[index] = newsize;
             break;
 
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             if (index < 0) {
-                block = 0;
+                mm_free(0);
             } else {
-                block = trace->blocks[index];
+                mm_release(trace, index);
             }
-            mm_free(block);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            if (!mm_alloc_batch(trace, &trace->ops[i]))
+                app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            mm_release_batch(trace, &trace->ops[i]);
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_speed");
         }
+
+        if (compact_due(trace, i, &last_compact))
+            mm_compact(trace, NULL, i);
+    }
+    mm_destroy_pools();
+    mm_destroy_arenas(trace);
 }
 
 /*
@@ -1321,7 +1822,7 @@ static void eval_mm_speed(void *ptr)
  */
 static bool eval_libc_valid(trace_t *trace)
 {
-    int i;
+    int i, j;
     size_t newsize;
     char *p, *newp, *oldp;
 
@@ -1338,6 +1839,23 @@ static bool eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+                malloc_error(trace, i, "libc calloc failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case MEMALIGN: /* posix_memalign */
+            if (posix_memalign((void **)&p, trace->ops[i].align,
+                               trace->ops[i].size) != 0) {
+                malloc_error(trace, i, "libc posix_memalign failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1356,6 +1874,21 @@ static bool eval_libc_valid(trace_t *trace)
             }
             break;
 
+        case ALLOC_BATCH: /* malloc, count times */
+            for (j = 0; j < trace->ops[i].count; j++) {
+                if ((p = malloc(trace->ops[i].size)) == NULL) {
+                    malloc_error(trace, i, "libc malloc failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index + j] = p;
+            }
+            break;
+
+        case FREE_BATCH: /* free, count times */
+            for (j = 0; j < trace->ops[i].count; j++)
+                free(trace->blocks[trace->ops[i].index + j]);
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1371,7 +1904,7 @@ static bool eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index;
     size_t size, newsize;
     char *p, *newp, *oldp, *block;
@@ -1389,6 +1922,22 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case CALLOC: /* calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = calloc(1, size)) == NULL)
+                unix_error("calloc failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case MEMALIGN: /* posix_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+                unix_error("posix_memalign failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1408,15 +1957,345 @@ static void eval_libc_speed(void *ptr)
                 free(0);
             }
             break;
+
+        case ALLOC_BATCH: /* malloc, count times */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            for (j = 0; j < trace->ops[i].count; j++) {
+                if ((p = malloc(size)) == NULL)
+                    unix_error("malloc failed in eval_libc_speed");
+                trace->blocks[index + j] = p;
+            }
+            break;
+
+        case FREE_BATCH: /* free, count times */
+            index = trace->ops[i].index;
+            for (j = 0; j < trace->ops[i].count; j++)
+                free(trace->blocks[index + j]);
+            break;
         }
     }
 }
 
+/*
+ * mm_alloc_batch - Allocates the blocks of batch request op into
+ *     trace->blocks, with one mm_malloc_batch call (or, with -U or if the
+ *     allocator has none, one mm_malloc per block, or with -E, one
+ *     mm_arena_alloc per block in an arena of the batch's own, if the
+ *     trace's batches are paired). Returns false if any block was not
+ *     allocated.
+ */
+static bool mm_alloc_batch(trace_t *trace, const traceop_t *op)
+{
+    char **ptrs = &trace->blocks[op->index];
+    mm_arena_t *arena;
+    int j;
+
+    for (j = 0; j < op->count; j++)
+        trace->block_sizes[op->index + j] = op->size;
+
+    if (arenas && trace->batches_paired) {
+        if (num_spare_arenas > 0)
+            arena = spare_arenas[--num_spare_arenas];
+        else if ((arena = mm_arena_create()) == NULL)
+            return false;
+        trace->batch_arenas[op->index] = arena;
+        for (j = 0; j < op->count; j++)
+            if ((ptrs[j] = mm_arena_alloc(arena, op->size)) == NULL)
+                return false;
+        return true;
+    }
+
+    if (!unbatch && mm_malloc_batch != NULL)
+        return mm_malloc_batch(op->size, op->count, (void **)ptrs)
+            == (size_t)op->count;
+
+    for (j = 0; j < op->count; j++)
+        if ((ptrs[j] = mm_malloc(op->size)) == NULL)
+            return false;
+    return true;
+}
+
+/*
+ * mm_release_batch - Frees the blocks of batch request op with one
+ *     mm_free_batch call (or, with -U or if the allocator has none, one
+ *     mm_free per block, or with -E, one mm_arena_reset). The freed entries
+ *     of trace->blocks may be left reordered.
+ */
+static void mm_release_batch(trace_t *trace, const traceop_t *op)
+{
+    char **ptrs = &trace->blocks[op->index];
+    mm_arena_t *arena = trace->batch_arenas[op->index];
+    int j;
+
+    if (arena != NULL) {
+        trace->batch_arenas[op->index] = NULL;
+        if (num_spare_arenas == MAX_SPARE_ARENAS) {
+            mm_arena_destroy(arena);
+            return;
+        }
+        mm_arena_reset(arena);
+        spare_arenas[num_spare_arenas++] = arena;
+        return;
+    }
+    if (!unbatch && mm_free_batch != NULL) {
+        mm_free_batch((void **)ptrs, op->count);
+        return;
+    }
+    for (j = 0; j < op->count; j++)
+        mm_release(trace, op->index + j);
+}
+
+/*
+ * mm_release - Frees the block of id index with mm_free, or with -S with
+ *     mm_free_sized and the size it was last allocated with. A pool slot
+ *     goes back to its pool, and with -H an object with its handle.
+ */
+static void mm_release(trace_t *trace, int index)
+{
+    if (trace->block_handles[index] != NULL) {
+        mm_hfree(trace->block_handles[index]);
+        trace->block_handles[index] = NULL;
+    }
+    else if (trace->block_pools[index] != NULL) {
+        mm_pool_free(trace->block_pools[index], trace->blocks[index]);
+        trace->block_pools[index] = NULL;
+    }
+    else if (sized_free)
+        mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
+    else
+        mm_free(trace->blocks[index]);
+}
+
+/*
+ * mm_acquire - Allocates size bytes for the block of id index with
+ *     mm_malloc, or with -P from the pool for that size, made on first use,
+ *     or with -H as the object of a new handle, returned locked.
+ */
+static char *mm_acquire(trace_t *trace, int index, size_t size)
+{
+    mm_handle_t *handle;
+
+    if (handles && size > 0) {
+        if ((handle = mm_halloc(size)) == NULL)
+            return NULL;
+        trace->block_handles[index] = handle;
+        return mm_hlock(handle);
+    }
+    if (!pooled || size == 0 || size > POOL_MAX_BYTES)
+        return mm_malloc(size);
+
+    if (pools[size] == NULL && (pools[size] = mm_pool_create(size)) == NULL)
+        return NULL;
+    trace->block_pools[index] = pools[size];
+    return mm_pool_alloc(pools[size]);
+}
+
+/*
+ * mm_resize - Reallocates the block of id index with mm_realloc. A pool
+ *     slot cannot change size, so with -P it moves to a block from
+ *     mm_malloc. With -H the object moves to a new handle, as handles have
+ *     no realloc. block_sizes[index] must hold its size.
+ */
+static char *mm_resize(trace_t *trace, int index, size_t size)
+{
+    char *oldp = trace->blocks[index];
+    char *newp = NULL;
+    size_t oldsize = trace->block_sizes[index];
+    mm_handle_t *handle = NULL;
+    size_t i;
+
+    if (trace->block_pools[index] == NULL
+        && trace->block_handles[index] == NULL)
+        return mm_realloc(oldp, size);
+
+    if (size > 0) {
+        if (trace->block_handles[index] != NULL) {
+            if ((handle = mm_halloc(size)) == NULL)
+                return NULL;
+            newp = mm_hlock(handle);
+        }
+        else if ((newp = mm_malloc(size)) == NULL)
+            return NULL;
+        for (i = 0; i < size && i < oldsize; i++)
+            mem_write(newp + i, mem_read(oldp + i, 1), 1);
+    }
+    mm_release(trace, index);
+    trace->block_handles[index] = handle;
+    return newp;
+}
+
+/*
+ * mm_destroy_pools - Destroys the pools made with -P during a run, so the
+ *     next run starts with none.
+ */
+static void mm_destroy_pools(void)
+{
+    size_t size;
+
+    for (size = 0; size <= POOL_MAX_BYTES; size++) {
+        if (pools[size] != NULL)
+            mm_pool_destroy(pools[size]);
+        pools[size] = NULL;
+    }
+}
+
+/*
+ * mm_destroy_arenas - Destroys the arenas made with -E during a run, both
+ *     those of batches still allocated and the spare ones.
+ */
+static void mm_destroy_arenas(trace_t *trace)
+{
+    int index;
+
+    for (index = 0; index < trace->num_ids; index++) {
+        if (trace->batch_arenas[index] != NULL)
+            mm_arena_destroy(trace->batch_arenas[index]);
+        trace->batch_arenas[index] = NULL;
+    }
+    while (num_spare_arenas > 0)
+        mm_arena_destroy(spare_arenas[--num_spare_arenas]);
+}
+
+/*
+ * compact_due - With -H, whether to compact after op opnum: a free at
+ *     least num_ops / COMPACT_POINTS ops after the last compaction, whose
+ *     op number *last holds and is updated.
+ */
+static bool compact_due(const trace_t *trace, int opnum, int *last)
+{
+    if (!handles || trace->ops[opnum].type != FREE
+        || opnum - *last < trace->num_ops / COMPACT_POINTS)
+        return false;
+    *last = opnum;
+    return true;
+}
+
+/*
+ * mm_compact - Unlocks every handle, calls mm_hcompact until its pass is
+ *     done, then locks them all again and updates trace->blocks. With
+ *     ranges, the moved payloads get their ranges moved and are checked
+ *     for their data, and the heap is checked; returns false if a check
+ *     failed.
+ */
+static bool mm_compact(trace_t *trace, range_set_t *ranges, int opnum)
+{
+    mm_handle_t *handle;
+    int index;
+
+    for (index = 0; index < trace->num_ids; index++) {
+        if ((handle = trace->block_handles[index]) == NULL)
+            continue;
+        /* All ranges go first, as objects move into each other's places */
+        if (ranges != NULL)
+            remove_range(ranges, trace->blocks[index]);
+        mm_hunlock(handle);
+    }
+
+    while (!mm_hcompact(COMPACT_STEP))
+        ;
+
+    for (index = 0; index < trace->num_ids; index++) {
+        if ((handle = trace->block_handles[index]) == NULL)
+            continue;
+        trace->blocks[index] = mm_hlock(handle);
+        if (ranges == NULL)
+            continue;
+        if (!add_range(ranges, trace->blocks[index],
+                       trace->block_sizes[index], trace, opnum, index))
+            return false;
+        if (!check_index(trace, opnum, index))
+            return false;
+    }
+
+    if (ranges != NULL && !mm_checkheap(0)) {
+        malloc_error(trace, opnum, "mm_checkheap returned false after compacting");
+        return false;
+    }
+    return true;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
+/*
+ * print_realloc_report - prints, for each valid trace, its realloc count,
+ *     how many reallocs fit in the block's usable size (same pointer back),
+ *     the bytes the allocator copied (memcpy/memmove), the peak and final
+ *     size of the heap plus mapped regions and the bytes of pages released
+ *     by shrinking the heap or unmapping regions.
+ *     All but the first are taken from the utilization run.
+ */
+static void print_realloc_report(int n, stats_t *stats)
+{
+    int i;
+    int sumfit = 0;
+    size_t sumcopied = 0;
+    size_t sumpeak = 0;
+    size_t sumheap = 0;
+    size_t sumreleased = 0;
+
+    printf("Realloc report:\n");
+    printf("  %8s %8s %12s %12s %12s %12s  %s\n", "reallocs", "fit",
+           "copied(KB)", "peak(KB)", "final(KB)", "released(KB)", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf("  %8d %8d %12.1f %12.1f %12.1f %12.1f  %s\n",
+               stats[i].reallocs, stats[i].fit_reallocs,
+               stats[i].copied / 1024.0, stats[i].peak_heapsize / 1024.0,
+               stats[i].heapsize / 1024.0, stats[i].released / 1024.0,
+               stats[i].filename);
+        sumfit += stats[i].fit_reallocs;
+        sumcopied += stats[i].copied;
+        sumpeak += stats[i].peak_heapsize;
+        sumheap += stats[i].heapsize;
+        sumreleased += stats[i].released;
+    }
+    printf("  %8s %8d %12.1f %12.1f %12.1f %12.1f\n\n", "total", sumfit,
+           sumcopied / 1024.0, sumpeak / 1024.0, sumheap / 1024.0,
+           sumreleased / 1024.0);
+}
+
+/*
+ * print_compact_report - prints, for each valid trace, how many times -H
+ *     compacted it in the utilization run, the bytes that moved, and the
+ *     utilization just before and just after compacting: payload bytes
+ *     allocated over heap plus mapped bytes, summed over the compactions.
+ */
+static void print_compact_report(int n, stats_t *stats)
+{
+    int i;
+    int sumcount = 0;
+    size_t sumlive = 0;
+    size_t sumbefore = 0;
+    size_t sumafter = 0;
+    size_t summoved = 0;
+
+    printf("Compaction report:\n");
+    printf("  %8s %12s %8s %8s  %s\n", "compacts", "moved(KB)", "before",
+           "after", "trace");
+    for (i = 0; i < n; i++) {
+        compact_stats_t *c = &stats[i].compact;
+        if (!stats[i].valid || c->count == 0)
+            continue;
+        printf("  %8d %12.1f %7.1f%% %7.1f%%  %s\n", c->count,
+               c->moved / 1024.0, 100.0 * c->live / c->before,
+               100.0 * c->live / c->after, stats[i].filename);
+        sumcount += c->count;
+        sumlive += c->live;
+        sumbefore += c->before;
+        sumafter += c->after;
+        summoved += c->moved;
+    }
+    if (sumcount > 0)
+        printf("  %8d %12.1f %7.1f%% %7.1f%%\n\n", sumcount,
+               summoved / 1024.0, 100.0 * sumlive / sumbefore,
+               100.0 * sumlive / sumafter);
+}
+
 /*
  * printresults - prints a performance summary for some malloc package and returns
  *                a summary of the stats to the caller. 
@@ -1429,6 +2308,7 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     double sumsecs = 0;
     double sumops  = 0;
     double sumutil = 0;
+    size_t sumsbrks = 0;
     int sum_perf_weight = 0;
     int sum_util_weight = 0;
 
@@ -1437,10 +2317,10 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
 
     /* Print the individual results for each trace */
     if (tab_mode) {
-        printf("valid\tthru?\tutil?\tutil\tops\tmsecs\tKops\ttrace\n");
+        printf("valid\tthru?\tutil?\tutil\tsbrks\tops\tmsecs\tKops\ttrace\n");
     } else {
-        printf("  %5s  %6s %7s%8s%8s  %s\n",
-               "valid", "util", "ops", "msecs", "Kops", "trace");
+        printf("  %5s  %6s %7s %7s%8s%8s  %s\n",
+               "valid", "util", "sbrks", "ops", "msecs", "Kops", "trace");
     }
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
@@ -1488,6 +2368,13 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
                     printf(" %8s", "--");
             }
 
+            /* Heap growth calls */
+            if (tab_mode) {
+                printf("%zu\t", stats[i].sbrks);
+            } else {
+                printf(" %7zu", stats[i].sbrks);
+            }
+
             /* Ops + Time */
             double msecs = sparse_mode ? 0.0 : stats[i].secs * 1000.0;
             double kops = sparse_mode ? 0.0 : (stats[i].ops*1e-3)/stats[i].secs;
@@ -1516,18 +2403,20 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
                     sum_util_weight += 1;
                     sumutil += stats[i].util;
                 }
+            sumsbrks += stats[i].sbrks;
         }
         else {
             if (tab_mode) {
-                printf("no\t\t\t\t\t\t\t%s\n", stats[i].filename);
+                printf("no\t\t\t\t\t\t\t\t%s\n", stats[i].filename);
             } else {
-                printf("%2s%4s%7s%10s%7s%10s %s\n",
+                printf("%2s%4s%7s%8s%10s%7s%10s %s\n",
                        stats[i].weight != 0 ? "*" : "",
                        "no",
                        "-",
                        "-",
                        "-",
                        "-",
+                       "-",
                        stats[i].filename);
             }
         }
@@ -1545,16 +2434,17 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
         if (sparse_mode)
             sumsecs = 0;
         if (tab_mode) {
-            // "valid\tthru?\tutil?\tutil\tops\tmsecs\tKops\ttrace"
-            printf("Sum\t%d\t%d\t%.1f\t%.0f\t\%.2f\n",
-                   sum_perf_weight, sum_util_weight, sumutil*100.0, sumops, sumsecs * 1000.0);
-            printf("Avg\t\t\t%.1f\t\t\t%.0f\n",
+            // "valid\tthru?\tutil?\tutil\tsbrks\tops\tmsecs\tKops\ttrace"
+            printf("Sum\t%d\t%d\t%.1f\t%zu\t%.0f\t\%.2f\n",
+                   sum_perf_weight, sum_util_weight, sumutil*100.0, sumsbrks, sumops, sumsecs * 1000.0);
+            printf("Avg\t\t\t%.1f\t\t\t\t%.0f\n",
                    util, tput);
         } else {
-            printf("%2d %2d  %7.1f%%%8.0f%10.3f%7.0f\n",
+            printf("%2d %2d  %7.1f%% %7zu%8.0f%10.3f%7.0f\n",
                    sum_util_weight,
                    sum_perf_weight,
                    util,
+                   sumsbrks,
                    sumops,
                    sumsecs * 1000.0,
                    tput);
@@ -1801,11 +2691,18 @@ static void usage(char *prog)
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
     fprintf(stderr, "\t-c <file>  Run trace file <file> twice, check for correctness only.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-B <p,..>  Benchmark only default traces starting with a prefix (e.g. bdd,ngram).\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
+    fprintf(stderr, "\t-R         Report bytes copied and heap sizes per trace.\n");
+    fprintf(stderr, "\t-U         Replay batch requests as single malloc/free calls.\n");
+    fprintf(stderr, "\t-S         Replay frees as mm_free_sized calls.\n");
+    fprintf(stderr, "\t-P         Replay requests up to 1 KiB from per-size mm_pools.\n");
+    fprintf(stderr, "\t-E         Replay each batch request in an mm_arena.\n");
+    fprintf(stderr, "\t-H         Replay requests through mm_halloc handles, compact, report.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
 }
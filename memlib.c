@@ -26,17 +26,37 @@ typedef struct MBLK {
     unsigned char bytes[SPARSE_PAGE_SIZE]; /* Page contents */
 } mem_block_t;
 
+/* A region handed out by mem_map */
+typedef struct {
+    unsigned char *lo;                     /* First byte of region */
+    size_t length;                         /* Bytes mapped, a multiple of the page size */
+} mem_region_t;
+
 /* private global variables */
 static bool sparse = false;                 /* Use sparse memory emulation */
 static unsigned char *heap;                 /* Starting address of heap */
 static unsigned char *mem_brk;              /* Current position of break */
+static unsigned char *mem_peak_brk;         /* Highest break since reset */
+static unsigned char *mem_dirty_end;        /* Bytes past the break may be nonzero below this */
 static unsigned char *mem_max_addr;         /* Maximum allowable heap address */
 static size_t mmap_length = MAX_DENSE_HEAP; /* Number of bytes allocated by mmap */
 static bool show_stats = false;             /* Should program print allocation information? */
 static bool stats_printed = false;          /* Has information been printed about allocation */
+static size_t bytes_copied = 0;             /* Bytes moved by mem_memcpy/mem_memmove since reset */
+static size_t bytes_released = 0;           /* Bytes of pages dropped by shrinking or unmapping since reset */
+static size_t sbrk_calls = 0;               /* Calls to mem_sbrk that grew the heap since reset */
+
+/* Regions from mem_map, outside the heap */
+static mem_region_t *regions = NULL;        /* Live regions, sorted by address */
+static size_t num_regions = 0;              /* Number of live regions */
+static size_t max_regions = 0;              /* Capacity of regions */
+static size_t mapped_bytes = 0;             /* Total length of live regions */
+static size_t peak_footprint = 0;           /* Largest heap size plus mapped_bytes since reset */
+static unsigned char *map_brk;              /* Next sparse region address, above mem_max_addr */
 
 /* Sparse memory representation */
 static mem_block_t *next_free_page = NULL;  /* Next free page */
+static mem_block_t *clean_page = NULL;      /* Pages from here on were never handed out */
 static size_t num_pages = 0;                /* Total number of pages */
 static size_t num_free_pages = 0;           /* Number of free pages */
 static mem_block_t **page_table = NULL;     /* Hash table from page ID to page */
@@ -48,6 +68,9 @@ static size_t num_buckets = 0;              /* Number of buckets in page table *
 static size_t page_id(const void *addr);
 static void *page_start(size_t id);
 static void *get_mem(const void *addr);
+static bool emulated(const void *addr, size_t len);
+static size_t find_region(const void *addr);
+static void unmap_regions(void);
 static void print_stats();
 
 /* 
@@ -97,6 +120,8 @@ void mem_init(bool do_sparse){
     }
     stats_printed = false;
     mem_brk = heap;
+    mem_dirty_end = heap;
+    clean_page = NULL;
     mem_reset_brk();
 }
 
@@ -105,51 +130,106 @@ void mem_init(bool do_sparse){
  */
 void mem_deinit(void){
     print_stats();
+    unmap_regions();
+    free(regions);
+    regions = NULL;
+    max_regions = 0;
     munmap(heap, mmap_length);
     next_free_page = NULL;
+    clean_page = NULL;
     num_free_pages = 0;
     page_table = NULL;
     num_buckets = 0;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ * and unmap every region from mem_map. Dense pages are kept, so the old
+ * heap is left dirty (see mem_zero_start). Sparse pages are cleared as
+ * get_mem hands them out again, so a sparse heap starts clean.
  */
 void mem_reset_brk(){
     print_stats();
+    unmap_regions();
     if (sparse) {
         /* Clear page table */
         size_t ptb = num_buckets * sizeof(mem_block_t *);
         memset((void *) page_table, 0, ptb);
         /* First page is just beyond page table */
         next_free_page = (mem_block_t *) ((unsigned char *) page_table + ptb);
+        if (clean_page == NULL)
+            clean_page = next_free_page;
         num_free_pages = num_pages;
+        mem_dirty_end = heap;
+    } else if (mem_brk > mem_dirty_end) {
+        mem_dirty_end = mem_brk;
     }
     mem_brk = heap;
+    mem_peak_brk = heap;
+    map_brk = mem_max_addr;
+    peak_footprint = 0;
+    bytes_copied = 0;
+    bytes_released = 0;
+    sbrk_calls = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *                by incr bytes and returns the start address of the new area. In
- *                this model, the heap cannot be shrunk.
+ *                by incr bytes and returns the start address of the new area.
+ *                A negative incr shrinks the heap; in the dense model the
+ *                whole pages past the new break are handed back to the
+ *                system with madvise(MADV_DONTNEED) and the bytes around
+ *                them are cleared, so all of it reads as zero if the heap
+ *                grows over it again. In the sparse model it is left dirty.
  */
 void *mem_sbrk(intptr_t incr) {
     unsigned char *old_brk = mem_brk;
 
     bool ok = true;
     if (incr < 0) {
-        ok = false;
-        fprintf(stderr, "ERROR: mem_sbrk failed.  Attempt to expand heap by negative value %ld\n", (long) incr);
+        if ((size_t) -incr > (size_t) (mem_brk - heap)) {
+            fprintf(stderr, "ERROR: mem_sbrk failed.  Attempt to shrink heap by %ld bytes below its start\n", (long) -incr);
+            errno = ENOMEM;
+            return (void *) -1;
+        }
+        mem_brk += incr;
+        /* Old dirty bytes past the break go too */
+        unsigned char *end = old_brk > mem_dirty_end ? old_brk : mem_dirty_end;
+        if (sparse) {
+            mem_dirty_end = end;
+        } else {
+            size_t pagesize = mem_pagesize();
+            uintptr_t lo = ((uintptr_t) mem_brk + pagesize - 1) & ~(pagesize - 1);
+            uintptr_t hi = (uintptr_t) end & ~(pagesize - 1);
+            if (hi > lo && madvise((void *) lo, hi - lo, MADV_DONTNEED) == 0) {
+                bytes_released += hi - lo;
+                memset(mem_brk, 0, lo - (uintptr_t) mem_brk);
+                memset((void *) hi, 0, (uintptr_t) end - hi);
+            } else {
+                memset(mem_brk, 0, end - mem_brk);
+            }
+            mem_dirty_end = mem_brk;
+        }
+        return (void *) old_brk;
     } else if (mem_brk + incr > mem_max_addr) {
         ok = false;
         size_t alloc = mem_brk - heap + incr;
         fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory.  Would require heap size of %zd (0x%zx) bytes\n", alloc, alloc);
-    } else if (!sparse && sbrk(incr) == (void*) -1) {
+    } else if (!sparse && mem_brk + incr > mem_peak_brk &&
+               sbrk(mem_brk + incr - mem_peak_brk) == (void*) -1) {
+        /* Only growth past the peak is charged to sbrk: space below it
+           was charged before the heap shrank */
         ok = false;
         fprintf(stderr, "ERROR: mem_sbrk failed.  Could not allocate more heap space\n");
     }
     if (ok) {
+        if (incr > 0)
+            sbrk_calls++;
         mem_brk += incr;
+        if (mem_brk > mem_peak_brk)
+            mem_peak_brk = mem_brk;
+        if (mem_heapsize() + mapped_bytes > peak_footprint)
+            peak_footprint = mem_heapsize() + mapped_bytes;
         return (void *) old_brk;
     } else {
         errno = ENOMEM;
@@ -178,6 +258,145 @@ size_t mem_heapsize() {
     return (size_t)(mem_brk - heap);
 }
 
+/*
+ * mem_zero_start() - returns the address from which memory past the break
+ * reads as zero: the heap only grows into zero memory above it. Memory
+ * below it was used by an earlier heap, or was given back by shrinking
+ * the sparse heap, and has not been cleared.
+ */
+void *mem_zero_start() {
+    return (void *) mem_dirty_end;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size since the last reset
+ */
+size_t mem_peak_heapsize() {
+    return (size_t)(mem_peak_brk - heap);
+}
+
+/*
+ * mem_bytes_released() - returns the bytes of whole pages given back to
+ * the system by shrinking the heap or unmapping regions since the last reset
+ */
+size_t mem_bytes_released() {
+    return bytes_released;
+}
+
+/*
+ * mem_sbrk_calls() - returns the number of mem_sbrk calls that grew the
+ * heap since the last reset
+ */
+size_t mem_sbrk_calls() {
+    return sbrk_calls;
+}
+
+/*
+ * mem_map - maps a region of at least length bytes of its own, apart from
+ *           the heap, and returns its page-aligned start, or NULL on
+ *           failure. The length is rounded up to a multiple of the page
+ *           size. Regions read as zero: dense ones come from mmap, and
+ *           sparse ones are emulated above the heap on pages that get_mem
+ *           clears.
+ */
+void *mem_map(size_t length) {
+    size_t pagesize = mem_pagesize();
+    if (length == 0 || length > SIZE_MAX - pagesize) {
+        fprintf(stderr, "ERROR: mem_map failed.  Bad region length %zu\n", length);
+        return NULL;
+    }
+    length = (length + pagesize - 1) & ~(pagesize - 1);
+
+    unsigned char *lo;
+    if (sparse) {
+        if (length > (size_t) (mem_max_addr + MAX_SPARSE_HEAP - map_brk)) {
+            fprintf(stderr, "ERROR: mem_map failed.  Ran out of region space for %zu bytes\n", length);
+            return NULL;
+        }
+        lo = map_brk;
+        map_brk += length;
+    } else {
+        lo = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (lo == MAP_FAILED) {
+            fprintf(stderr, "ERROR: mem_map failed.  Could not map %zu bytes\n", length);
+            return NULL;
+        }
+    }
+
+    if (num_regions == max_regions) {
+        size_t new_max = max_regions ? 2 * max_regions : 64;
+        mem_region_t *new_regions = realloc(regions, new_max * sizeof(mem_region_t));
+        if (new_regions == NULL) {
+            fprintf(stderr, "ERROR: mem_map failed.  Could not record region\n");
+            if (!sparse)
+                munmap(lo, length);
+            return NULL;
+        }
+        regions = new_regions;
+        max_regions = new_max;
+    }
+    /* Sparse regions are handed out in address order, so this is O(1) there */
+    size_t i = num_regions;
+    while (i > 0 && regions[i - 1].lo > lo) {
+        regions[i] = regions[i - 1];
+        i--;
+    }
+    regions[i].lo = lo;
+    regions[i].length = length;
+    num_regions++;
+
+    mapped_bytes += length;
+    if (mem_heapsize() + mapped_bytes > peak_footprint)
+        peak_footprint = mem_heapsize() + mapped_bytes;
+    return (void *) lo;
+}
+
+/*
+ * mem_unmap - unmaps the region starting at ptr, which must have come
+ *             from mem_map. Returns false if there is no such region.
+ */
+bool mem_unmap(void *ptr) {
+    size_t i = find_region(ptr);
+    if (i == num_regions || regions[i].lo != (unsigned char *) ptr) {
+        fprintf(stderr, "ERROR: mem_unmap failed.  No region starts at %p\n", ptr);
+        return false;
+    }
+    size_t length = regions[i].length;
+    if (!sparse)
+        munmap(ptr, length);
+    mapped_bytes -= length;
+    bytes_released += length;
+    num_regions--;
+    memmove(&regions[i], &regions[i + 1], (num_regions - i) * sizeof(mem_region_t));
+    return true;
+}
+
+/*
+ * mem_in_region - returns whether the len bytes at addr lie inside a
+ *                 single region from mem_map
+ */
+bool mem_in_region(const void *addr, size_t len) {
+    size_t i = find_region(addr);
+    return i < num_regions &&
+        (size_t) ((unsigned char *) addr - regions[i].lo) + len <= regions[i].length;
+}
+
+/*
+ * mem_mapped_bytes() - returns the total length of the regions mapped now
+ */
+size_t mem_mapped_bytes() {
+    return mapped_bytes;
+}
+
+/*
+ * mem_peak_footprint() - returns the largest heap size plus mapped bytes
+ * since the last reset
+ */
+size_t mem_peak_footprint() {
+    return peak_footprint;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -204,8 +423,7 @@ void mem_write128(void* addr, __int128 val)
 /* Read len bytes and return value zero-extended to 64 bits */
 uint64_t mem_read(const void *addr, size_t len) {
     uint64_t rdata;
-    if (sparse &&
-        (unsigned char *) addr >= heap && (unsigned char *) addr+len <= mem_brk) {
+    if (sparse && emulated(addr, len)) {
         /* Heap read.  Check if it crosses page boundary */
         size_t id = page_id(addr);
         void *paddr = get_mem(addr);
@@ -237,8 +455,7 @@ uint64_t mem_read(const void *addr, size_t len) {
 
 /* Write lower order len bytes of val to address */
 void mem_write(void *addr, uint64_t val, size_t len) {
-    if (sparse &&
-        (unsigned char *) addr >= heap && (unsigned char *) addr+len <= mem_brk) {
+    if (sparse && emulated(addr, len)) {
         /* Heap write.  Check to see if it crosses page boundary */
         size_t id = page_id(addr);
         void *paddr = get_mem(addr);
@@ -273,6 +490,7 @@ void mem_write(void *addr, uint64_t val, size_t len) {
 void *mem_memcpy(void *dst, const void *src, size_t n) {
     void *savedst = dst;
     size_t w = sizeof(uint64_t);
+    bytes_copied += n;
     while (n >= w) {
         uint64_t data = mem_read(src, w);
         mem_write(dst, data, w);
@@ -287,6 +505,34 @@ void *mem_memcpy(void *dst, const void *src, size_t n) {
     return savedst;
 }
 
+/* Emulation of memmove.  Copies from the top down when dst is above src */
+void *mem_memmove(void *dst, const void *src, size_t n) {
+    if ((uintptr_t) dst <= (uintptr_t) src)
+        return mem_memcpy(dst, src, n);
+    size_t w = sizeof(uint64_t);
+    size_t tail = n % w;
+    bytes_copied += n;
+    if (tail) {
+        n -= tail;
+        uint64_t data = mem_read((unsigned char *) src + n, tail);
+        mem_write((unsigned char *) dst + n, data, tail);
+    }
+    while (n >= w) {
+        n -= w;
+        uint64_t data = mem_read((unsigned char *) src + n, w);
+        mem_write((unsigned char *) dst + n, data, w);
+    }
+    return dst;
+}
+
+/*
+ * mem_bytes_copied - bytes moved by mem_memcpy and mem_memmove since the
+ * heap was last reset
+ */
+size_t mem_bytes_copied() {
+    return bytes_copied;
+}
+
 /* Emulation of memset */
 void *mem_memset(void *dst, int c, size_t n) {
     void *savedst = dst;
@@ -362,6 +608,36 @@ static void *page_start(size_t id) {
     return (void *) ((unsigned char *) SPARSE_HEAP_START + offset);
 }
 
+/* Does the sparse model hold the len bytes at addr, in the heap or a region? */
+static bool emulated(const void *addr, size_t len) {
+    unsigned char *lo = (unsigned char *) addr;
+    return (lo >= heap && lo + len <= mem_brk) ||
+        (lo >= mem_max_addr && lo + len <= map_brk);
+}
+
+/* Index of the last region starting at or below addr, or num_regions if none */
+static size_t find_region(const void *addr) {
+    size_t lo = 0, hi = num_regions;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (regions[mid].lo <= (unsigned char *) addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo == 0 ? num_regions : lo - 1;
+}
+
+/* Unmap every live region, as a fresh heap has none */
+static void unmap_regions(void) {
+    size_t i;
+    if (!sparse)
+        for (i = 0; i < num_regions; i++)
+            munmap(regions[i].lo, regions[i].length);
+    num_regions = 0;
+    mapped_bytes = 0;
+}
+
 /* Get memory to store value.  Allocate page if necessary */
 static void *get_mem(const void *addr) {
     size_t id = page_id(addr);
@@ -377,6 +653,11 @@ static void *get_mem(const void *addr) {
         }
         block = next_free_page++;
         num_free_pages--;
+        /* A page used before the last reset still holds its old bytes */
+        if (block < clean_page)
+            memset(block->bytes, 0, SPARSE_PAGE_SIZE);
+        else
+            clean_page = block + 1;
         block->id = id;
         block->next = page_table[b];
         page_table[b] = block;
@@ -9,6 +9,15 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+void *mem_zero_start(void);
+size_t mem_peak_heapsize(void);
+size_t mem_bytes_released(void);
+size_t mem_sbrk_calls(void);
+void *mem_map(size_t length);
+bool mem_unmap(void *ptr);
+bool mem_in_region(const void *addr, size_t len);
+size_t mem_mapped_bytes(void);
+size_t mem_peak_footprint(void);
 size_t mem_pagesize(void);
 
 /* Functions used for memory emulation */
@@ -24,6 +33,12 @@ void mem_write(void *addr, uint64_t val, size_t len);
 /* Emulation of memcpy */
 void *mem_memcpy(void *dst, const void *src, size_t n);
 
+/* Emulation of memmove */
+void *mem_memmove(void *dst, const void *src, size_t n);
+
+/* Bytes copied by mem_memcpy and mem_memmove since the last mem_reset_brk */
+size_t mem_bytes_copied(void);
+
 /* Emulation of memset */
 void *mem_memset(void *dst, int c, size_t n);
 
@@ -0,0 +1,978 @@
+/*
+ ******************************************************************************
+ *                                 mm-tlsf.c                                  *
+ *           64-bit Two-Level Segregated Fit (TLSF) memory allocator          *
+ *                  15-213: Introduction to Computer Systems                  *
+ *                                                                            *
+ *  ************************************************************************  *
+ *  Uses the same block layout as mm.c: an 8 byte header holding the size,  *
+ *  the allocation bit and a prev_alloc bit; allocated blocks have no       *
+ *  footer, free blocks have a footer and next/prev links in their payload.  *
+ *                                                                            *
+ *  Free blocks are kept in a two-level table of lists. The first level is   *
+ *  the power of two below the block size, the second level splits that     *
+ *  power of two into SL_COUNT lists of equal width. Blocks under           *
+ *  small_block_size all share first level 0, split in dsize steps.         *
+ *  Each level has a bitmap of non-empty lists, so malloc finds a list      *
+ *  whose every block is big enough with two count-trailing-zeros, and      *
+ *  free and coalesce only unlink and link list heads: both are O(1).       *
+ *                                                                            *
+ *  Build with "make MM=mm-tlsf.c" to run it under mdriver.                   *
+ *  ************************************************************************  *
+ *                                                                            *
+ ******************************************************************************
+ */
+
+/* Do not change the following! */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#ifdef DRIVER
+/* create aliases for driver tests */
+#define malloc mm_malloc
+#define free mm_free
+#define realloc mm_realloc
+#define calloc mm_calloc
+#define memset mem_memset
+#define memcpy mem_memcpy
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#endif /* def DRIVER */
+
+/* You can change anything from here onward */
+
+#include <errno.h>
+
+/*
+ * If DEBUG is defined, enable printing on dbg_printf and contracts.
+ * Debugging macros, with names beginning "dbg_" are allowed.
+ * You may not define any other macros having arguments.
+ */
+// #define DEBUG // uncomment this line to enable debugging
+
+#ifdef DEBUG
+/* When debugging is enabled, these form aliases to useful functions */
+#define dbg_printf(...) printf(__VA_ARGS__)
+#define dbg_requires(...) assert(__VA_ARGS__)
+#define dbg_assert(...) assert(__VA_ARGS__)
+#define dbg_ensures(...) assert(__VA_ARGS__)
+#else
+/* When debugging is disnabled, no code gets generated for these */
+#define dbg_printf(...)
+#define dbg_requires(...)
+#define dbg_assert(...)
+#define dbg_ensures(...)
+#endif
+
+/* Basic constants */
+typedef uint64_t word_t;
+static const size_t wsize = sizeof(word_t);   // word and header size (bytes)
+static const size_t dsize = 2*wsize;          // double word size (bytes)
+static const size_t min_block_size = 2*dsize; // Minimum block size
+static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
+
+/* log2 of the number of second level lists per first level */
+static const size_t sl_shift = 4;
+static const size_t SL_COUNT = 16;            // 1 << sl_shift
+/* Blocks below this size are all in first level 0, one list per dsize */
+static const size_t small_shift = 8;          // sl_shift + log2(dsize)
+static const size_t small_block_size = 256;   // 1 << small_shift
+/* First level 0 is the small blocks, then one per power of two up to 2^63 */
+static const size_t FL_COUNT = 57;            // 64 - small_shift + 1
+
+static const word_t alloc_mask = 0x1;
+/* Set when the block just below this one is allocated, as in mm.c */
+static const word_t prev_alloc_mask = 0x2;
+static const word_t size_mask = ~(word_t)0xF;
+
+
+typedef struct block
+{
+    /* Header contains size + allocation flag + previous allocation flag */
+    word_t header;
+
+    /* Payload of an allocated block, or list links of a free block */
+    union
+    {
+        char payload[0];
+        struct
+        {
+            struct block *next;
+            struct block *prev;
+        };
+    };
+
+    /* Only free blocks have a footer, after the payload */
+} block_t;
+
+/* Global variables */
+/* Pointer to first block */
+static block_t *heap_start = NULL;
+/* Heads of the (null terminated, doubly linked) free lists */
+static block_t *free_lists[FL_COUNT][SL_COUNT];
+/* bit fl is set iff some list of first level fl is non-empty */
+static word_t fl_bitmap = 0;
+/* bit sl of sl_bitmap[fl] is set iff free_lists[fl][sl] is non-empty */
+static word_t sl_bitmap[FL_COUNT];
+
+bool mm_checkheap(int lineno);
+bool check_free_lists();
+bool check_heap();
+
+/* Function prototypes for internal helper routines */
+static block_t *extend_heap(size_t size);
+static void place(block_t *block, size_t asize);
+static block_t *find_fit(size_t asize);
+static block_t *coalesce(block_t *block);
+
+static void mapping_insert(size_t size, size_t *fl, size_t *sl);
+static void mapping_search(size_t size, size_t *fl, size_t *sl);
+static void insert_free_block(block_t *block);
+static void remove_free_block(block_t *block);
+static size_t find_first_set(word_t bits);
+static size_t find_last_set(word_t bits);
+
+static size_t max(size_t x, size_t y);
+static size_t round_up(size_t size, size_t n);
+static word_t pack(size_t size, bool alloc, bool prev_alloc);
+
+static size_t extract_size(word_t header);
+static size_t get_size(block_t *block);
+static size_t get_payload_size(block_t *block);
+
+static bool extract_alloc(word_t header);
+static bool get_alloc(block_t *block);
+static bool get_prev_alloc(block_t *block);
+
+static void write_header(block_t *block, size_t size, bool alloc,
+                         bool prev_alloc);
+static void write_footer(block_t *block, size_t size);
+static void set_prev_alloc(block_t *block, bool prev_alloc);
+
+static block_t *payload_to_header(void *bp);
+static void *header_to_payload(block_t *block);
+
+static block_t *find_next(block_t *block);
+static word_t *find_prev_footer(block_t *block);
+static block_t *find_prev(block_t *block);
+
+
+/*
+ * Sets up the prologue footer and epilogue header, empties the free lists
+ * and extends the heap with a first free chunk.
+ */
+bool mm_init(void)
+{
+    // Create the initial empty heap
+    word_t *start = (word_t *)(mem_sbrk(2*wsize));
+
+    if (start == (void *)-1)
+    {
+        return false;
+    }
+
+    start[0] = pack(0, true, false); // Prologue footer
+    start[1] = pack(0, true, true);  // Epilogue header
+    // Heap starts with first "block header", currently the epilogue footer
+    heap_start = (block_t *) &(start[1]);
+
+    for (size_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        for (size_t sl = 0; sl < SL_COUNT; sl++)
+        {
+            free_lists[fl][sl] = NULL;
+        }
+        sl_bitmap[fl] = 0;
+    }
+    fl_bitmap = 0;
+
+    // Extend the empty heap with a free block of chunksize bytes
+    if (extend_heap(chunksize) == NULL)
+    {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Takes a request size, finds a free block through the two level bitmaps
+ * (extending the heap if there is none) and places the request in it.
+ */
+void *malloc(size_t size)
+{
+    dbg_requires(mm_checkheap(__LINE__));
+    size_t asize;      // Adjusted block size
+    size_t extendsize; // Amount to extend heap if no fit is found
+    block_t *block;
+    void *bp = NULL;
+
+    if (heap_start == NULL) // Initialize heap if it isn't initialized
+    {
+        mm_init();
+    }
+
+    if (size == 0) // Ignore spurious request
+    {
+        dbg_ensures(mm_checkheap(__LINE__));
+        return bp;
+    }
+
+    // Adjust block size to include the header and to meet alignment
+    // requirements. The block must still fit a footer and links once freed.
+    asize = max(round_up(size + wsize, dsize), min_block_size);
+
+    block = find_fit(asize);
+
+    // If no fit is found, request more memory, and then and place the block
+    if (block == NULL)
+    {
+        extendsize = max(asize, chunksize);
+        block = extend_heap(extendsize);
+        if (block == NULL) // extend_heap returns an error
+        {
+            return bp;
+        }
+    }
+
+    place(block, asize);
+    bp = header_to_payload(block);
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    return bp;
+}
+
+/*
+ * Takes pointer to a payload, marks its block free and coalesces it with
+ * free neighbours.
+ */
+void free(void *bp)
+{
+    if (bp == NULL)
+    {
+        return;
+    }
+
+    block_t *block = payload_to_header(bp);
+    size_t size = get_size(block);
+
+    write_header(block, size, false, get_prev_alloc(block));
+    write_footer(block, size);
+
+    coalesce(block);
+    dbg_ensures(mm_checkheap(__LINE__));
+}
+
+/*
+ * Takes pointer to a payload and size of reallocation, allocates a new
+ * block, copies the payload over and frees the old block.
+ */
+void *realloc(void *ptr, size_t size)
+{
+    block_t *block = payload_to_header(ptr);
+    size_t copysize;
+    void *newptr;
+
+    // If size == 0, then free block and return NULL
+    if (size == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    // If ptr is NULL, then equivalent to malloc
+    if (ptr == NULL)
+    {
+        return malloc(size);
+    }
+
+    // Otherwise, proceed with reallocation
+    newptr = malloc(size);
+    // If malloc fails, the original block is left untouched
+    if (newptr == NULL)
+    {
+        return NULL;
+    }
+
+    // Copy the old data
+    copysize = get_payload_size(block); // gets size of old payload
+    if (size < copysize)
+    {
+        copysize = size;
+    }
+    memcpy(newptr, ptr, copysize);
+
+    // Free the old block
+    free(ptr);
+
+    return newptr;
+}
+
+/*
+ * Allocates an array of elements of size bytes each, zeroed.
+ */
+void *calloc(size_t elements, size_t size)
+{
+    void *bp;
+    size_t asize = elements * size;
+
+    if (asize/elements != size)
+    // Multiplication overflowed
+    return NULL;
+
+    bp = malloc(asize);
+    if (bp == NULL)
+    {
+        return NULL;
+    }
+    // Initialize all bits to 0
+    memset(bp, 0, asize);
+
+    return bp;
+}
+
+/*
+ * Takes a power of two alignment and a size and returns a payload of that
+ * size aligned to it, or NULL. A free block with room for the payload and
+ * a gap of at least min_block_size is split in front of the payload, and
+ * the aligned rest is placed like any free block.
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return NULL;
+    }
+    if (alignment <= dsize)
+    {
+        return malloc(size);
+    }
+    if (heap_start == NULL)
+    {
+        mm_init();
+    }
+    if (size == 0 || size > (size_t)-1 - 2 * alignment - min_block_size)
+    {
+        return NULL;
+    }
+
+    size_t asize = max(round_up(size + wsize, dsize), min_block_size);
+    size_t fit_size = asize + alignment + min_block_size;
+    block_t *block = find_fit(fit_size);
+    if (block == NULL)
+    {
+        block = extend_heap(max(fit_size, chunksize));
+        if (block == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    size_t csize = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+    size_t payload = round_up((size_t)header_to_payload(block), alignment);
+    if (payload != (size_t)header_to_payload(block)
+        && payload - (size_t)header_to_payload(block) < min_block_size)
+    {
+        payload += alignment;
+    }
+    block_t *aligned = payload_to_header((void *)payload);
+    size_t lead = (size_t)((char *)aligned - (char *)block);
+
+    remove_free_block(block);
+    if (lead > 0)
+    {
+        write_header(block, lead, false, prev_alloc);
+        write_footer(block, lead);
+        insert_free_block(block);
+        prev_alloc = false;
+    }
+    write_header(aligned, csize - lead, false, prev_alloc);
+    write_footer(aligned, csize - lead);
+    insert_free_block(aligned);
+    place(aligned, asize);
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    return header_to_payload(aligned);
+}
+
+/* POSIX form of memalign, returning EINVAL or ENOMEM on failure */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0
+        || alignment % sizeof(void *) != 0)
+    {
+        return EINVAL;
+    }
+
+    void *bp = memalign(alignment, size);
+    if (bp == NULL && size != 0)
+    {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/* C11 form of memalign */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/* Bytes the payload at ptr can hold; 0 for NULL */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return 0;
+    }
+    return get_payload_size(payload_to_header(ptr));
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+/*
+ * Extends the heap by size bytes (rounded to dsize), turning the old
+ * epilogue into the header of a new free block, and coalesces it with a
+ * free block before it. Returns the resulting free block.
+ */
+static block_t *extend_heap(size_t size)
+{
+    void *bp;
+
+    // Allocate an even number of words to maintain alignment
+    size = round_up(size, dsize);
+    if ((bp = mem_sbrk(size)) == (void *)-1)
+    {
+        return NULL;
+    }
+
+    // The old epilogue header becomes the new block's header; its
+    // prev_alloc bit already records whether the last block is allocated
+    block_t *block = payload_to_header(bp);
+    write_header(block, size, false, get_prev_alloc(block));
+    write_footer(block, size);
+
+    // Create new epilogue header
+    block_t *block_next = find_next(block);
+    write_header(block_next, 0, true, false);
+
+    // Coalesce in case the previous block was free
+    return coalesce(block);
+}
+
+/*
+ * Takes in a free block that is not on any list yet, merges it with free
+ * neighbours (unlinking them first), puts the result on its list and
+ * tells the block after it that its predecessor is free.
+ */
+static block_t *coalesce(block_t *block)
+{
+    block_t *block_next = find_next(block);
+    size_t size = get_size(block);
+
+    if (!get_alloc(block_next))
+    {
+        remove_free_block(block_next);
+        size += get_size(block_next);
+    }
+
+    if (!get_prev_alloc(block))
+    {
+        block_t *block_prev = find_prev(block);
+        remove_free_block(block_prev);
+        size += get_size(block_prev);
+        block = block_prev;
+    }
+
+    write_header(block, size, false, get_prev_alloc(block));
+    write_footer(block, size);
+    insert_free_block(block);
+    set_prev_alloc(find_next(block), false);
+    return block;
+}
+
+/*
+ * Takes in a free block and the adjusted request size, unlinks the block,
+ * marks it allocated and puts any remainder of at least min_block_size
+ * back on a free list.
+ */
+static void place(block_t *block, size_t asize)
+{
+    size_t csize = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+
+    remove_free_block(block);
+
+    if ((csize - asize) >= min_block_size)
+    {
+        write_header(block, asize, true, prev_alloc);
+
+        block_t *block_next = find_next(block);
+        write_header(block_next, csize - asize, false, true);
+        write_footer(block_next, csize - asize);
+        insert_free_block(block_next);
+    }
+    else
+    {
+        write_header(block, csize, true, prev_alloc);
+        set_prev_alloc(find_next(block), true);
+    }
+}
+
+/*
+ * Takes in an adjusted request size and returns a free block at least that
+ * big, or NULL. mapping_search rounds the size up to the next list
+ * boundary, so every block of the list it names, and of any list above,
+ * fits: the head of the first non-empty one is taken without a walk.
+ */
+static block_t *find_fit(size_t asize)
+{
+    size_t fl, sl;
+    mapping_search(asize, &fl, &sl);
+    if (fl >= FL_COUNT)
+    {
+        return NULL;
+    }
+
+    // Non-empty lists of first level fl, from sl up
+    word_t sl_map = sl_bitmap[fl] & (~(word_t)0 << sl);
+    if (sl_map == 0)
+    {
+        // Otherwise the first non-empty first level above fl
+        word_t fl_map = fl_bitmap & (~(word_t)0 << (fl + 1));
+        if (fl_map == 0)
+        {
+            return NULL;
+        }
+        fl = find_first_set(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = find_first_set(sl_map);
+    return free_lists[fl][sl];
+}
+
+/*
+ * Takes in a block size and returns the indices of the list holding it.
+ * Small blocks go to first level 0 in dsize steps; larger ones use the
+ * position of their top bit and the sl_shift bits below it.
+ */
+static void mapping_insert(size_t size, size_t *fl, size_t *sl)
+{
+    if (size < small_block_size)
+    {
+        *fl = 0;
+        *sl = size / dsize;
+        return;
+    }
+    size_t top = find_last_set(size);
+    *sl = (size >> (top - sl_shift)) ^ SL_COUNT;
+    *fl = top - small_shift + 1;
+}
+
+/*
+ * Takes in a request size and returns the indices of the first list whose
+ * blocks are all at least that big, by rounding the size up to the next
+ * list boundary before mapping it. fl is FL_COUNT when none can be.
+ */
+static void mapping_search(size_t size, size_t *fl, size_t *sl)
+{
+    if (size >= small_block_size)
+    {
+        size_t round = ((size_t)1 << (find_last_set(size) - sl_shift)) - 1;
+        if (size > ~round)
+        {
+            *fl = FL_COUNT;
+            return;
+        }
+        size += round;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+/* Takes in a free block and pushes it on the front of its list */
+static void insert_free_block(block_t *block)
+{
+    size_t fl, sl;
+    mapping_insert(get_size(block), &fl, &sl);
+
+    block_t *head = free_lists[fl][sl];
+    block -> next = head;
+    block -> prev = NULL;
+    if (head != NULL)
+    {
+        head -> prev = block;
+    }
+    free_lists[fl][sl] = block;
+    sl_bitmap[fl] |= (word_t)1 << sl;
+    fl_bitmap |= (word_t)1 << fl;
+}
+
+/* Takes in a free block and unlinks it from its list */
+static void remove_free_block(block_t *block)
+{
+    size_t fl, sl;
+    mapping_insert(get_size(block), &fl, &sl);
+
+    if (block -> prev != NULL)
+    {
+        block -> prev -> next = block -> next;
+    }
+    else
+    {
+        free_lists[fl][sl] = block -> next;
+    }
+    if (block -> next != NULL)
+    {
+        block -> next -> prev = block -> prev;
+    }
+
+    if (free_lists[fl][sl] == NULL)
+    {
+        sl_bitmap[fl] &= ~((word_t)1 << sl);
+        if (sl_bitmap[fl] == 0)
+        {
+            fl_bitmap &= ~((word_t)1 << fl);
+        }
+    }
+}
+
+/* Takes in a non-zero bitmap and returns the index of its lowest set bit */
+static size_t find_first_set(word_t bits)
+{
+    dbg_requires(bits != 0);
+    return (size_t)__builtin_ctzll(bits);
+}
+
+/* Takes in a non-zero bitmap and returns the index of its highest set bit */
+static size_t find_last_set(word_t bits)
+{
+    dbg_requires(bits != 0);
+    return 63 - (size_t)__builtin_clzll(bits);
+}
+
+/* Checks the following:
+ * - Every list links both ways and holds only free blocks in the heap,
+ *   which map back to that list,
+ * - The bitmaps mark exactly the non-empty lists.
+ */
+bool check_free_lists()
+{
+    for (size_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        if (((fl_bitmap >> fl) & 1) != (sl_bitmap[fl] != 0))
+        {
+            return false;
+        }
+        for (size_t sl = 0; sl < SL_COUNT; sl++)
+        {
+            block_t *block = free_lists[fl][sl];
+            if (((sl_bitmap[fl] >> sl) & 1) != (block != NULL))
+            {
+                return false;
+            }
+            if (block != NULL && block -> prev != NULL)
+            {
+                return false;
+            }
+            for (; block != NULL; block = block -> next)
+            {
+                size_t block_fl, block_sl;
+                if ((void *)block < mem_heap_lo()
+                    || (void *)block > mem_heap_hi())
+                {
+                    return false;
+                }
+                if (get_alloc(block))
+                {
+                    return false;
+                }
+                if (block -> next != NULL && block -> next -> prev != block)
+                {
+                    return false;
+                }
+                mapping_insert(get_size(block), &block_fl, &block_sl);
+                if (block_fl != fl || block_sl != sl)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* Checks the following:
+ * - Prologue and epilogue are intact,
+ * - Every block is aligned, at least min_block_size, and agrees with the
+ *   prev_alloc bit of the block after it,
+ * - Free blocks have a matching footer and no free neighbour,
+ * - As many blocks are free in the heap as are on the free lists.
+ */
+bool check_heap()
+{
+    size_t num_free_heap = 0;
+    size_t num_free_list = 0;
+    block_t *block;
+
+    if (*find_prev_footer(heap_start) != pack(0, true, false))
+    {
+        return false;
+    }
+
+    for (block = heap_start; get_size(block) > 0; block = find_next(block))
+    {
+        if (((size_t)header_to_payload(block) % dsize) != 0)
+        {
+            return false;
+        }
+        if (get_size(block) < min_block_size)
+        {
+            return false;
+        }
+        if (get_prev_alloc(find_next(block)) != get_alloc(block))
+        {
+            return false;
+        }
+        if (!get_alloc(block))
+        {
+            num_free_heap++;
+            if (*find_prev_footer(find_next(block))
+                != pack(get_size(block), false, false))
+            {
+                return false;
+            }
+            if (!get_alloc(find_next(block)))
+            {
+                return false;
+            }
+        }
+    }
+    if (!get_alloc(block))
+    {
+        return false;
+    }
+
+    for (size_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        for (size_t sl = 0; sl < SL_COUNT; sl++)
+        {
+            for (block = free_lists[fl][sl]; block != NULL;
+                 block = block -> next)
+            {
+                num_free_list++;
+            }
+        }
+    }
+    return num_free_heap == num_free_list;
+}
+
+/*
+ * Runs the free list and heap checks, reporting the caller's line number
+ * if one fails.
+ */
+bool mm_checkheap(int line)
+{
+    if (!check_free_lists())
+    {
+        printf("HEAP CHECK FAILED ON FREE LISTS. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
+    if (!check_heap())
+    {
+        printf("HEAP CHECK FAILED ON HEAP TEST. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ *****************************************************************************
+ * The functions below are short wrapper functions to perform                *
+ * bit manipulation, pointer arithmetic, and other helper operations.        *
+ *****************************************************************************
+ */
+
+/*
+ * max: returns x if x > y, and y otherwise.
+ */
+static size_t max(size_t x, size_t y)
+{
+    return (x > y) ? x : y;
+}
+
+/*
+ * round_up: Rounds size up to next multiple of n
+ */
+static size_t round_up(size_t size, size_t n)
+{
+    return (n * ((size + (n-1)) / n));
+}
+
+/*
+ * pack: returns a header reflecting a specified size and its alloc status.
+ *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ *       If the previous block is allocated, the second bit is set to 1.
+ */
+static word_t pack(size_t size, bool alloc, bool prev_alloc)
+{
+    word_t w = alloc ? (size | alloc_mask) : size;
+    if (prev_alloc)
+    {
+        w |= prev_alloc_mask;
+    }
+    return w;
+}
+
+/*
+ * extract_size: returns the size of a given header value based on the header
+ *               specification above.
+ */
+static size_t extract_size(word_t word)
+{
+    return (word & size_mask);
+}
+
+/*
+ * get_size: returns the size of a given block by clearing the lowest 4 bits
+ *           (as the heap is 16-byte aligned).
+ */
+static size_t get_size(block_t *block)
+{
+    return extract_size(block->header);
+}
+
+/*
+ * get_payload_size: returns the payload size of a given allocated block,
+ *                   equal to the entire block size minus the header size.
+ */
+static size_t get_payload_size(block_t *block)
+{
+    return get_size(block) - wsize;
+}
+
+/*
+ * extract_alloc: returns the allocation status of a given header value based
+ *                on the header specification above.
+ */
+static bool extract_alloc(word_t word)
+{
+    return (bool)(word & alloc_mask);
+}
+
+/*
+ * get_alloc: returns true when the block is allocated based on the
+ *            block header's lowest bit, and false otherwise.
+ */
+static bool get_alloc(block_t *block)
+{
+    return extract_alloc(block->header);
+}
+
+/*
+ * get_prev_alloc: returns true when the block before this one is allocated,
+ *                 based on the second lowest bit of the block header.
+ */
+static bool get_prev_alloc(block_t *block)
+{
+    return (bool)(block->header & prev_alloc_mask);
+}
+
+/*
+ * write_header: given a block, its size, its allocation status and that of
+ *               the previous block, writes an appropriate value to the
+ *               block header.
+ */
+static void write_header(block_t *block, size_t size, bool alloc,
+                         bool prev_alloc)
+{
+    block->header = pack(size, alloc, prev_alloc);
+}
+
+/*
+ * write_footer: given a free block and its size, writes an appropriate
+ *               value to the block footer by first computing the position
+ *               of the footer. Allocated blocks have no footer.
+ */
+static void write_footer(block_t *block, size_t size)
+{
+    word_t *footerp = (word_t *)((block->payload) + size - dsize);
+    *footerp = pack(size, false, false);
+}
+
+/*
+ * set_prev_alloc: updates the prev_alloc bit in the header of a block,
+ *                 leaving its size and allocation status untouched.
+ */
+static void set_prev_alloc(block_t *block, bool prev_alloc)
+{
+    if (prev_alloc)
+    {
+        block->header |= prev_alloc_mask;
+    }
+    else
+    {
+        block->header &= ~prev_alloc_mask;
+    }
+}
+
+/*
+ * find_next: returns the next consecutive block on the heap by adding the
+ *            size of the block.
+ */
+static block_t *find_next(block_t *block)
+{
+    return (block_t *)(((char *)block) + get_size(block));
+}
+
+/*
+ * find_prev_footer: returns the footer of the previous block.
+ */
+static word_t *find_prev_footer(block_t *block)
+{
+    // Compute previous footer position as one word before the header
+    return (&(block->header)) - 1;
+}
+
+/*
+ * find_prev: returns the previous block position by checking the previous
+ *            block's footer and calculating the start of the previous block
+ *            based on its size. Only valid when the previous block is free.
+ */
+static block_t *find_prev(block_t *block)
+{
+    word_t *footerp = find_prev_footer(block);
+    size_t size = extract_size(*footerp);
+    return (block_t *)((char *)block - size);
+}
+
+/*
+ * payload_to_header: given a payload pointer, returns a pointer to the
+ *                    corresponding block.
+ */
+static block_t *payload_to_header(void *bp)
+{
+    return (block_t *)(((char *)bp) - offsetof(block_t, payload));
+}
+
+/*
+ * header_to_payload: given a block pointer, returns a pointer to the
+ *                    corresponding payload.
+ */
+static void *header_to_payload(block_t *block)
+{
+    return (void *)(block->payload);
+}
@@ -22,16 +22,23 @@
 #define calloc mm_calloc
 #define memset mem_memset
 #define memcpy mem_memcpy
+#define memmove mem_memmove
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
 #endif /* def DRIVER */
 
 /* You can change anything from here onward */
 
+#include <errno.h>
+
 /*
  * If DEBUG is defined, enable printing on dbg_printf and contracts.
  * Debugging macros, with names beginning "dbg_" are allowed.
  * You may not define any other macros having arguments.
  */
 // #define DEBUG // uncomment this line to enable debugging
+// #define COMPACT // uncomment this line for 32-bit headers and links
 
 #ifdef DEBUG
 /* When debugging is enabled, these form aliases to useful functions */
@@ -49,25 +56,199 @@
 
 /* Basic constants */
 typedef uint64_t word_t;
-static const size_t wsize = sizeof(word_t);   // word and header size (bytes)
+
+/* Block headers and footers are hword_t, and the links of free blocks are
+ * link_t. By default both are 64 bits wide and links are pointers. With
+ * COMPACT, headers are 32 bits, holding sizes up to 4 GiB, and a link is
+ * the block's distance from heap_start in dsize units, plus one so that 0
+ * is NULL; that would reach 64 GiB, but the header caps the heap at
+ * heap_max (4 GiB) first. A free 16 byte block then has room for both
+ * links and a footer, so COMPACT has no mini blocks. Past heap_max,
+ * requests are served from mapped regions instead (see malloc).
+ */
+#ifdef COMPACT
+typedef uint32_t hword_t;
+typedef uint32_t link_t;
+static const size_t heap_max = ((size_t)1 << 32);
+#else
+typedef word_t hword_t;
+typedef struct block *link_t;
+static const size_t heap_max = (size_t)-1;
+#endif
+
+static const size_t wsize = sizeof(word_t);   // word size (bytes)
+static const size_t hsize = sizeof(hword_t);  // header and footer size (bytes)
 static const size_t dsize = 2*wsize;          // double word size (bytes)
-static const size_t min_block_size = 2*dsize; // Minimum block size
+static const size_t min_block_size = dsize;   // Minimum (mini) block size
 static const size_t chunksize = (1 << 12);    // requires (chunksize % 16 == 0)
 //static const size_t threshold = 128;
-static const size_t NUM_LISTS = 16;
+/* Number of segregated free lists (size classes): 16, 32, 64 or 128 */
+static const size_t NUM_LISTS = 64;
+/* Words of free_list_bitmap, one bit per list */
+static const size_t BITMAP_WORDS = (NUM_LISTS + 63) / 64;
+/* Free blocks larger than tree_min (a list bound) are kept in free_tree
+ * instead of the lists above it, for a best fit in logarithmic time.
+ */
+static const size_t tree_min = (1 << 16);
+
+/* Order of the blocks in each segregated list, and so which block the
+ * first-fit walk in find_seg_fit takes. FIFO appends every freed block
+ * at the tail; ADDRESS_ORDERED keeps each list sorted by address, so the
+ * walk is address-ordered first fit. On the bundled traces both give the
+ * same utilization and FIFO is faster; address order helps heaps with
+ * long-lived random frees.
+ */
+typedef enum
+{
+    PLACEMENT_FIFO,
+    PLACEMENT_ADDRESS_ORDERED
+} placement_t;
+
+static const placement_t placement_policy = PLACEMENT_FIFO;
+
+/* Freed blocks of up to quick_max bytes go to the quick bin for their
+ * exact size without coalescing; they keep their allocated header so
+ * neighbours leave them alone. The bins are consolidated (freed and
+ * coalesced for real) when a fit fails or they hold over quick_limit bytes.
+ */
+static const size_t quick_max = 256;
+static const size_t NUM_QUICK_BINS = 16;    // quick_max / dsize
+static const size_t quick_limit = (1 << 14);
+
+/* When a free leaves the block next to the epilogue free and over
+ * trim_threshold bytes, the heap is shrunk so that only trim_pad bytes
+ * of it remain, returning the rest to memlib.
+ */
+static const size_t trim_threshold = (1 << 17);
+static const size_t trim_pad = (1 << 12);   // requires (trim_pad % 16 == 0)
+
+/* How the heap grows when no free block fits a request. GROWTH_FIXED
+ * extends it by max(asize, chunksize). GROWTH_GEOMETRIC extends it by
+ * grow_step, which starts at chunksize and doubles with every growth up
+ * to growth_max, and starts over when the heap is trimmed; no growth
+ * adds more than a (1 << growth_shift)th of the heap, so small heaps do
+ * not overshoot their peak by much. A request that lacks the step or
+ * more, counting the free block at the end of the heap, grows it by
+ * exactly what it lacks so no big chunk is left over. Keep growth_max
+ * below trim_threshold, or a free would trim off what the last growth
+ * just added.
+ */
+typedef enum
+{
+    GROWTH_FIXED,
+    GROWTH_GEOMETRIC
+} growth_t;
+
+static const growth_t growth_policy = GROWTH_GEOMETRIC;
+static const size_t growth_max = (1 << 16);  // requires (growth_max % 16 == 0)
+static const size_t growth_shift = 4;       // grow by at most 1/16th
+
+/* Blocks over map_threshold bytes get a region of their own from mem_map
+ * and are unmapped when freed. The region starts with its length; the
+ * block header follows with size 0, which no heap block but the epilogue
+ * has, and the payload after it is dsize aligned.
+ */
+static const size_t map_threshold = (1 << 17);
+
+/* Compact description of the size classes. Blocks up to exact_max bytes
+ * get one list per dsize step; above that every power of two is split
+ * into (1 << sub_shift) lists of equal width. The last list has no upper
+ * bound. class_specs holds one spec per supported NUM_LISTS, in order.
+ */
+typedef struct
+{
+    size_t exact_max;
+    size_t sub_shift;
+} class_spec_t;
+
+static const class_spec_t class_specs[] =
+{
+    {32, 0},    // 16 lists:  32, 64, 128, ... 512K, unbounded
+    {64, 1},    // 32 lists:  32..64 exact, then 2 per power of two
+    {256, 2},   // 64 lists:  32..256 exact, then 4 per power of two
+    {1024, 2}   // 128 lists: 32..1024 exact, then 4 per power of two
+};
+
+/* Requests up to slab_max bytes are served from runs: run_size byte
+ * allocated blocks whose payload starts on a run_size boundary and
+ * holds a run_t followed by equal, headerless
+ * slots. A slot's run is found by rounding its address down, and
+ * page_map records which run_size windows of the heap are runs.
+ */
+static const size_t run_shift = 11;        // log2 of run_size
+static const size_t run_size = (1 << 11);
+/* Can be raised up to 512, the largest slot size below */
+static const size_t slab_max = 64;
+static const size_t NUM_SLAB_CLASSES = 16;
+/* page_map is a two level radix table over the run_size windows of the
+ * heap. A leaf has a byte per window, so it covers 8 MB of heap; the
+ * first is static and the others are mapped once a run lies in them. The
+ * root has PAGE_MAP_ROOTS leaves, covering the first 32 GB.
+ */
+static const size_t PAGE_LEAF_SIZE = 4096;
+static const size_t PAGE_MAP_ROOTS = 4096;
 
-static const word_t alloc_mask = 0x1;
-static const word_t size_mask = ~(word_t)0xF;
+/* A pool's first chunk has pool_chunk_min bytes, and each one after it
+ * twice as many, up to pool_chunk_max. Every pool keeps the peak of its
+ * own size, so small chunks leave less of that unused.
+ */
+static const size_t pool_chunk_min = (1 << 10);
+static const size_t pool_chunk_max = (1 << 12);
+
+/* Arena chunks grow the same way from arena_chunk_min to arena_chunk_max
+ * bytes. Requests over arena_large get a chunk of their own instead, so
+ * that no more than an eighth of a chunk is left unused for lack of room.
+ */
+static const size_t arena_chunk_min = (1 << 10);
+static const size_t arena_chunk_max = (1 << 12);
+static const size_t arena_large = (1 << 9);
+
+/* Slot size of each slab class */
+static const size_t slab_class_size[16] =
+{
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512
+};
+
+/* Slab class for requests of up to 16 * i bytes, for i <= slab_max / 16 */
+static const unsigned char slab_class_of[33] =
+{
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8,
+    9, 9, 10, 10, 11, 11, 12, 12, 12, 12,
+    13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15
+};
+
+static const hword_t alloc_mask = 0x1;
+/* Set when the block just below this one is allocated. Allocated blocks
+ * have no footer, so this bit is the only way to know whether find_prev
+ * can read one.
+ */
+static const hword_t prev_alloc_mask = 0x2;
+/* Set when the block just below this one is a mini block. Free mini blocks
+ * are too small for a footer, so find_prev steps back by min_block_size.
+ * Only used without COMPACT (see is_mini).
+ */
+static const hword_t prev_mini_mask = 0x4;
+/* Set only in the header of a free mini block. Its one payload word holds
+ * next, so the size bits of its header hold the payload address of the
+ * previous free mini block instead, and extract_size reads the size from
+ * this bit.
+ */
+static const hword_t mini_free_mask = 0x8;
+static const hword_t size_mask = ~(hword_t)0xF;
 
 
 typedef struct block
 {
-    /* Header contains size + allocation flag  */
-    word_t header;
+    /* Header contains size + allocation flag + previous allocation flag */
+    hword_t header;
     
     /* Pointers were causing alignment issues so putting them in a union with
      * payload will allow them to never co-exist since payload will always be 
      * greater then or equal to 4*wsize 
+     * Mini blocks (min_block_size bytes) are the exception: they hold one
+     * payload word, so a free mini block keeps next here and prev in its
+     * header (see mini_free_mask).
      */
 
     /* This contains payload/pointers to next/prev block if a free block */
@@ -79,62 +260,270 @@ typedef struct block
         * pointer notation.
         */
         char payload[0];
-        /* next and prev pointers for free block */
+        /* next and prev links for free block (see get_link) */
         struct 
         {
-            struct block* next;
-            struct block* prev;
+            link_t next;
+            link_t prev;
+        };
+        /* links of a free block kept in free_tree */
+        struct
+        {
+            link_t child[2];
+            link_t parent;
         };
     };
     
     /*
      * We can't declare the footer as part of the struct, since its starting
-     * position is unknown
+     * position is unknown. Only free blocks have a footer.
      */
 } block_t;
 
+/* Start of a run's payload. used_map has a bit per slot, set while the
+ * slot is allocated; bits past capacity are always set.
+ */
+typedef struct run
+{
+    /* links in partial_runs while the run has a free slot */
+    struct run *next;
+    struct run *prev;
+    size_t slot_size;
+    size_t slab_class;
+    size_t used;
+    size_t capacity;
+    word_t used_map[4];
+} run_t;
+
+/* A pool of slot_size byte objects (see mm_pool_create). Each chunk is an
+ * ordinary allocated block whose first dsize bytes link to the chunk
+ * allocated before it. A free slot holds the next slot on free_slots.
+ */
+struct mm_pool
+{
+    size_t slot_size;
+    void *free_slots;
+    /* Slots from bump up to bump_end were never handed out */
+    char *bump;
+    char *bump_end;
+    void *chunks;
+    size_t chunk_size;
+};
+
+/* An arena (see mm_arena_create). Its chunks are ordinary allocated
+ * blocks linked, newest first, through their first dsize bytes. The one
+ * being carved, from bump up to bump_end, is first.
+ */
+struct mm_arena
+{
+    char *bump;
+    char *bump_end;
+    void *chunks;
+    size_t chunk_size;
+};
+
+/* A handle (see mm_halloc). Its object is an ordinary allocated block,
+ * never a slab slot, so mm_hcompact can move it while locks is 0.
+ */
+struct mm_handle
+{
+    /* The object's payload, or NULL while the handle is free */
+    void *ptr;
+    union
+    {
+        /* mm_hlock calls not yet undone by mm_hunlock */
+        size_t locks;
+        /* next handle on free_handles */
+        struct mm_handle *next_free;
+    };
+    /* Its index in compact_order, if the pass under way holds it */
+    size_t order;
+};
+
+/* A page of handles. Callers keep pointers to handles, so unlike the
+ * objects they must never move, and pages are mapped apart from the heap.
+ * The first used handles have been handed out; those since freed are on
+ * free_handles.
+ */
+typedef struct handle_page
+{
+    struct handle_page *next;
+    size_t used;
+    mm_handle_t handles[0];
+} handle_page_t;
+
 /* Global variables */
 /* Pointer to first block */
 static block_t *heap_start = NULL;
 /* pointer to first free block */
 static  block_t* free_list_start[NUM_LISTS];
+/* bit i is set iff free_list_start[i] is non-empty */
+static word_t free_list_bitmap[BITMAP_WORDS];
+/* Upper bound (inclusive) on the block sizes kept in each free list, built
+ * from class_specs by build_size_classes. find_best_index searches this
+ * table and check_free_list validates against it.
+ */
+static size_t list_bounds[NUM_LISTS];
+/* First list index whose blocks go to free_tree; its bit in
+ * free_list_bitmap is set iff free_tree is non-empty.
+ */
+static size_t tree_index;
+/* Treap of the free blocks above tree_min, ordered by (size, address)
+ * and heap-ordered on a hash of the address.
+ */
+static block_t *free_tree = NULL;
+/* list of free mini blocks, linked through next and their headers */
+static block_t *mini_free_list = NULL;
+/* The free block just below the epilogue, unless it is a mini block, or
+ * NULL. It is kept off the lists and the tree, and find_seg_fit only
+ * splits it when nothing else fits, from its low end, so it stays whole
+ * for large requests and for trim_heap.
+ */
+static block_t *wilderness = NULL;
+/* The heap base rounded down to run_size; run windows count from here */
+static char *run_base = NULL;
+/* Entry i is 1 + the slab class of the i-th run_size window from run_base
+ * if that window is a run, and 0 otherwise (see find_page_entry).
+ */
+static unsigned char *page_map[PAGE_MAP_ROOTS];
+static unsigned char first_page_leaf[PAGE_LEAF_SIZE];
+/* per slab class, a null terminated list of runs with a free slot */
+static run_t *partial_runs[NUM_SLAB_CLASSES];
+/* quick_bins[i] is a LIFO list, linked through next, of blocks of
+ * (i + 1) * dsize bytes; quick_bytes is their total size */
+static block_t *quick_bins[NUM_QUICK_BINS];
+static size_t quick_bytes = 0;
+/* Every heap byte from zero_start up to the epilogue is zero, except the
+ * header, links and footer of the last block when it is free. A block
+ * allocated out of free memory moves it past itself (see mark_dirty);
+ * last_zero_start is where it stood before the latest one, for calloc.
+ */
+static char *zero_start = NULL;
+static char *last_zero_start = NULL;
+/* Size of the next geometric growth of the heap (see growth_policy) */
+static size_t grow_step = 0;
+/* Handle pages, newest first, the free handles on them and the number
+ * of live ones */
+static handle_page_t *handle_pages = NULL;
+static mm_handle_t *free_handles = NULL;
+static size_t num_handles = 0;
+/* The compaction pass under way, if compact_order is not NULL: the
+ * handles live when it began, in address order, in a mapped region, and
+ * the index of the next one to move (see mm_hcompact). Handles freed
+ * since are NULL in it.
+ */
+static mm_handle_t **compact_order = NULL;
+static size_t compact_count = 0;
+static size_t compact_next = 0;
 
 bool mm_checkheap(int lineno);
 bool check_free_list();
+bool check_runs();
 bool check_bounds();
+bool check_quick_bins();
+bool check_zero_tail();
+bool check_handles();
+bool check_tree(block_t *node, block_t *parent, block_t *low, block_t *high,
+                int *count);
 
 /* Function prototypes for internal helper routines */
 static block_t *extend_heap(size_t size);
+static block_t *grow_heap(size_t asize);
 static void place(block_t *block, size_t asize);
+static void split_allocated(block_t *block, size_t asize);
+static block_t *resize_in_place(block_t *block, size_t asize);
 static block_t *find_fit(size_t asize);
 static block_t *coalesce(block_t *block);
+static void clear_boundary(block_t *block, block_t *upper);
+static void mark_dirty(block_t *block);
+static void clear_stale(void *bp, size_t size);
 
 static size_t max(size_t x, size_t y);
 static size_t round_up(size_t size, size_t n);
-static word_t pack(size_t size, bool alloc);
+static hword_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini);
+static bool is_mini(size_t size);
 
-static size_t extract_size(word_t header);
+static size_t extract_size(hword_t header);
 static size_t get_size(block_t *block);
 static size_t get_payload_size(block_t *block);
 
-static bool extract_alloc(word_t header);
+static bool extract_alloc(hword_t header);
 static bool get_alloc(block_t *block);
+static bool get_prev_alloc(block_t *block);
+static bool get_prev_mini(block_t *block);
 
-static void write_header(block_t *block, size_t size, bool alloc);
-static void write_footer(block_t *block, size_t size, bool alloc);
+static void write_header(block_t *block, size_t size, bool alloc,
+                         bool prev_alloc, bool prev_mini);
+static void write_footer(block_t *block, size_t size);
+static void write_next_prev_bits(block_t *block);
 
 static block_t *payload_to_header(void *bp);
 static void *header_to_payload(block_t *block);
 
 static block_t *find_next(block_t *block);
-static word_t *find_prev_footer(block_t *block);
+static hword_t *find_prev_footer(block_t *block);
 static block_t *find_prev(block_t *block);
 
+static block_t *get_link(link_t link);
+static link_t make_link(block_t *block);
+
 static void add_to_front(block_t* block, size_t place_index);
 static void change_connections(block_t* block, size_t change_index);
+static void add_in_order(block_t *block, size_t place_index);
+static void link_before(block_t *block, block_t *next);
+static bool keep_list_place(block_t *old, block_t *block, size_t size);
+static void insert_free_block(block_t *block);
+static void remove_free_block(block_t *block);
 static block_t *find_seg_fit(size_t asize);
+static block_t *find_list_fit(size_t asize);
 static size_t find_best_index(size_t asize);
 static size_t size_from_index(size_t index);
+static bool in_size_class(size_t size, size_t index);
+static void build_size_classes(void);
+static void set_list_bit(size_t index, bool nonempty);
+static bool get_list_bit(size_t index);
+static size_t find_first_set(word_t bits);
+
+static void tree_insert(block_t *block);
+static void tree_remove(block_t *block);
+static block_t *tree_find_fit(size_t asize);
+static void tree_rotate_up(block_t *node);
+static void tree_replace_child(block_t *parent, block_t *old_child,
+                               block_t *new_child);
+static bool tree_less(block_t *a, block_t *b);
+static word_t tree_priority(block_t *block);
+
+static run_t *find_run(void *bp);
+static unsigned char *find_page_entry(void *bp, bool create);
+static void *slab_alloc(size_t size);
+static void slab_free(run_t *run, void *bp);
+static run_t *new_run(size_t slab_class);
+static block_t *alloc_aligned_block(size_t asize, size_t align);
+static block_t *carve_aligned_block(block_t *block, size_t asize,
+                                    size_t align);
+static void link_run(run_t *run);
+static void unlink_run(run_t *run);
+static size_t get_usable_size(void *bp);
+
+static void release_block(block_t *block, size_t size);
+static block_t *heap_alloc(size_t asize);
+static void trim_heap(block_t *block);
+static void shrink_heap(block_t *block);
+static block_t *map_block(size_t asize);
+static void unmap_block(block_t *block);
+static bool is_mapped(block_t *block);
+static size_t get_mapped_length(block_t *block);
+static void quick_push(block_t *block, size_t size);
+static block_t *quick_pop(size_t asize);
+static void consolidate_quick_bins(void);
+static int compare_addresses(const void *a, const void *b);
+static bool pool_grow(mm_pool_t *pool);
+static void *arena_alloc_large(mm_arena_t *arena, size_t size);
+static mm_handle_t *new_handle(void);
+static void begin_compaction(void);
+static size_t move_handle(mm_handle_t *handle);
+static void sort_handles(mm_handle_t **order, size_t n);
+static void sift_handle(mm_handle_t **order, size_t i, size_t n);
 
 
 /*
@@ -146,28 +535,66 @@ bool mm_init(void)
 {
 
     // Create the initial empty heap 
-    word_t *start = (word_t *)(mem_sbrk(2*wsize));
+    hword_t *start = (hword_t *)(mem_sbrk(dsize));
 
     if (start == (void *)-1) 
     {
         return false;
     }
 
-    start[0] = pack(0, true); // Prologue footer
-    start[1] = pack(0, true); // Epilogue header
+    // The epilogue header ends the first double word, so that payloads
+    // are dsize aligned whatever the header size
+    start[dsize/hsize - 2] = pack(0, true, false, false); // Prologue footer
+    start[dsize/hsize - 1] = pack(0, true, true, false);  // Epilogue header
     // Heap starts with first "block header", currently the epilogue footer
-    heap_start = (block_t *) &(start[1]);
+    heap_start = (block_t *) &(start[dsize/hsize - 1]);
+    zero_start = (char *)heap_start;
+    last_zero_start = NULL;
 
-    // Extend the empty heap with a free block of chunksize bytes
-    if (extend_heap(chunksize) == NULL)
+    /* Initialize Free Lists before the first extend_heap adds to them */
+    build_size_classes();
+    for(size_t list_index = 0; list_index < NUM_LISTS; list_index++)
     {
-        return false;
+        free_list_start[list_index] = NULL;
+    }
+    for(size_t word = 0; word < BITMAP_WORDS; word++)
+    {
+        free_list_bitmap[word] = 0;
+    }
+    mini_free_list = NULL;
+    free_tree = NULL;
+    wilderness = NULL;
+
+    run_base = (char *)((word_t)start & ~(word_t)(run_size - 1));
+    // The other leaves were unmapped along with the old heap
+    memset(first_page_leaf, 0, PAGE_LEAF_SIZE);
+    page_map[0] = first_page_leaf;
+    for(size_t root = 1; root < PAGE_MAP_ROOTS; root++)
+    {
+        page_map[root] = NULL;
+    }
+    for(size_t slab_class = 0; slab_class < NUM_SLAB_CLASSES; slab_class++)
+    {
+        partial_runs[slab_class] = NULL;
+    }
+    for(size_t bin = 0; bin < NUM_QUICK_BINS; bin++)
+    {
+        quick_bins[bin] = NULL;
     }
+    quick_bytes = 0;
+    grow_step = chunksize;
+    // Handle pages and a compaction pass went with the old heap too
+    handle_pages = NULL;
+    free_handles = NULL;
+    num_handles = 0;
+    compact_order = NULL;
+    compact_count = 0;
+    compact_next = 0;
 
-    /* Initialize Free Lists */
-    for(size_t list_index = 0; list_index < NUM_LISTS; list_index++)
+    // Extend the empty heap with a free block of chunksize bytes
+    if (extend_heap(chunksize) == NULL)
     {
-        free_list_start[list_index] = NULL;
+        return false;
     }
 
     return true;
@@ -181,7 +608,6 @@ void *malloc(size_t size)
 {
     dbg_requires(mm_checkheap(__LINE__));
     size_t asize;      // Adjusted block size
-    size_t extendsize; // Amount to extend heap if no fit is found
     block_t *block;
     void *bp = NULL;
 
@@ -196,27 +622,58 @@ void *malloc(size_t size)
         return bp;
     }
 
-    // Adjust block size to include overhead and to meet alignment requirements
-    asize = round_up(size + dsize, dsize);
+    // Small requests take a slot in a run, unless no run can be made
+    if (size <= slab_max)
+    {
+        bp = slab_alloc(size);
+        if (bp != NULL)
+        {
+            dbg_ensures(mm_checkheap(__LINE__));
+            return bp;
+        }
+    }
+
+    // Adjust block size to include the header and to meet alignment
+    // requirements. The block must still fit a footer and links once freed.
+    asize = max(round_up(size + hsize, dsize), min_block_size);
 
-    // Search the respective free list for a fit
-    block = find_seg_fit(asize);
+    // Huge requests are mapped apart from the heap
+    if (asize > map_threshold)
+    {
+        block = map_block(asize);
+        if (block != NULL)
+        {
+            bp = header_to_payload(block);
+        }
+        dbg_ensures(mm_checkheap(__LINE__));
+        return bp;
+    }
 
-    // If no fit is found, request more memory, and then and place the block
-    if (block == NULL)
-    {  
-        extendsize = max(asize, chunksize);
-        block = extend_heap(extendsize);
-        if (block == NULL) // extend_heap returns an error
+    // A recently freed block of exactly this size is reused as it is
+    if (asize <= quick_max)
+    {
+        block = quick_pop(asize);
+        if (block != NULL)
         {
+            bp = header_to_payload(block);
+            dbg_ensures(mm_checkheap(__LINE__));
             return bp;
         }
-
     }
 
-    place(block, asize);
-    bp = header_to_payload(block);
+    // Search the free lists for a fit, growing the heap if none fits.
+    // Past heap_max the block gets a region of its own instead
+    block = heap_alloc(asize);
+    if (block == NULL)
+    {
+        block = map_block(asize);
+    }
+    if (block != NULL)
+    {
+        bp = header_to_payload(block);
+    }
 
+    dbg_ensures(bp == NULL || (size_t)bp % dsize == 0);
     dbg_ensures(mm_checkheap(__LINE__));
     return bp;
 } 
@@ -225,6 +682,7 @@ void *malloc(size_t size)
  * Takes pointer to a payload and then free's 
  * an allocted block from memory, and passes it to coalesce to see if 
  * merging with another free block is possible.
+ * Blocks of up to quick_max bytes are parked in a quick bin instead.
  */
 void free(void *bp)
 {
@@ -233,18 +691,70 @@ void free(void *bp)
         return;
     }
 
+    run_t *run = find_run(bp);
+    if (run != NULL)
+    {
+        slab_free(run, bp);
+        return;
+    }
+
     block_t *block = payload_to_header(bp); 
-    size_t size = get_size(block);
+    if (is_mapped(block))
+    {
+        unmap_block(block);
+        return;
+    }
+    release_block(block, get_size(block));
+}
+
+/*
+ * Takes a pointer to a payload and the size it was last allocated (or
+ * reallocated) with, and frees it like free() but derives the block size
+ * from that size instead of the header. A small size is looked up in
+ * page_map first, so a slab slot is freed without touching anything next
+ * to it. Whether the block is mapped is told from the size and the
+ * mapped regions, so the header is only read in debug builds.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    if (bp == NULL)
+    {
+        return;
+    }
 
-    write_header(block, size, false);
-    write_footer(block, size, false);
+    if (size <= slab_max)
+    {
+        run_t *run = find_run(bp);
+        if (run != NULL)
+        {
+            slab_free(run, bp);
+            return;
+        }
+    }
 
-    coalesce(block);
+    // Only blocks over map_threshold are mapped, except past heap_max where
+    // malloc maps any size. Regions never overlap the heap, so the heap
+    // bounds tell those from heap blocks realloc grew in place, without
+    // reading the header
+    block_t *block = payload_to_header(bp);
+    size_t asize = max(round_up(size + hsize, dsize), min_block_size);
+    if ((asize > map_threshold || heap_max != (size_t)-1)
+        && (bp < mem_heap_lo() || bp > mem_heap_hi()))
+    {
+        dbg_requires(is_mapped(block));
+        unmap_block(block);
+        return;
+    }
+    dbg_requires(!is_mapped(block) && get_size(block) == asize);
+    release_block(block, asize);
 }
 
 /*
  * Takes pointer to a payload and size of reallocation and then
  * reallocates a given block to a bigger size, then copys the payload over.
+ * The block is resized among its neighbours when possible (see
+ * resize_in_place); only then does realloc fall back to malloc, copy and
+ * free.
  */
 void *realloc(void *ptr, size_t size)
 {
@@ -265,6 +775,36 @@ void *realloc(void *ptr, size_t size)
         return malloc(size);
     }
 
+    // Nothing to do when size fits in the usable size and leaves too
+    // little to split off: a slot big enough, or a block of exactly asize.
+    // A slot too small has to move.
+    run_t *run = find_run(ptr);
+    size_t asize = max(round_up(size + hsize, dsize), min_block_size);
+    if (run != NULL ? size <= run -> slot_size : asize == get_size(block))
+    {
+        return ptr;
+    }
+
+    // A mapped block stays in its region while the new size is still
+    // over map_threshold and fits; any other size has to move
+    bool mapped = (run == NULL && is_mapped(block));
+    if (mapped && asize > map_threshold
+        && asize <= get_mapped_length(block) - (dsize - hsize))
+    {
+        return ptr;
+    }
+
+    // Grow or shrink using the neighbouring blocks if they allow it
+    if (run == NULL && !mapped)
+    {
+        block = resize_in_place(block, asize);
+        if (block != NULL)
+        {
+            dbg_ensures(mm_checkheap(__LINE__));
+            return header_to_payload(block);
+        }
+    }
+
     // Otherwise, proceed with reallocation
     newptr = malloc(size);
     // If malloc fails, the original block is left untouched
@@ -274,7 +814,7 @@ void *realloc(void *ptr, size_t size)
     }
 
     // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
+    copysize = get_usable_size(ptr); // gets size of old payload
     if(size < copysize)
     {
         copysize = size;
@@ -288,7 +828,9 @@ void *realloc(void *ptr, size_t size)
 }
 
 /*
- * <what does calloc do?>
+ * Takes a count and a size and returns a payload of count * size bytes,
+ * all zero, or NULL. Only bytes that may be stale are cleared (see
+ * clear_stale).
  */
 void *calloc(size_t elements, size_t size)
 {
@@ -299,257 +841,1785 @@ void *calloc(size_t elements, size_t size)
     // Multiplication overflowed
     return NULL;
     
+    last_zero_start = NULL;
     bp = malloc(asize);
     if (bp == NULL)
     {
         return NULL;
     }
-    // Initialize all bits to 0
-    memset(bp, 0, asize);
+    clear_stale(bp, asize);
 
     return bp;
 }
 
-/******** The remaining content below are helper and debug routines ********/
-
 /*
- * Takes in size and then increases heap size accordingly rounding it to dsize
+ * Takes a power of two alignment and a size and returns a payload of that
+ * size aligned to it, or NULL (also for a bad alignment). Alignments up to
+ * dsize are what malloc gives anyway. Larger ones are cut out of a free
+ * block big enough to hold an aligned payload; the gap before it and the
+ * rest after it go back to the free lists.
  */
-static block_t *extend_heap(size_t size) 
+void *memalign(size_t alignment, size_t size)
 {
-    void *bp;
+    dbg_requires(mm_checkheap(__LINE__));
 
-    // Allocate an even number of words to maintain alignment
-    size = round_up(size, dsize);
-    if ((bp = mem_sbrk(size)) == (void *)-1)
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
     {
         return NULL;
     }
+    if (alignment <= dsize)
+    {
+        return malloc(size);
+    }
 
-   
-    // Initialize free block header/footer 
-    block_t *block =  payload_to_header(bp);
-  
-    write_header(block, size, false);
-   
-    write_footer(block, size, false);
-
-    // Create new epilogue header
-    block_t *block_next = find_next(block);
-    write_header(block_next, 0, true);
+    if (heap_start == NULL)
+    {
+        mm_init();
+    }
+    // asize plus the alignment slack must not overflow
+    if (size == 0 || size > (size_t)-1 - 2 * alignment)
+    {
+        return NULL;
+    }
 
-    // Coalesce in case the previous block was free
-    return coalesce(block);
-}
+    size_t asize = max(round_up(size + hsize, dsize), min_block_size);
+    block_t *block = alloc_aligned_block(asize, alignment);
+    if (block == NULL)
+    {
+        return NULL;
+    }
 
-/* Takes in a pointer to a free block and free list index for 
- * that block then Adds the free block to the place before free_list_start. 
- * The free_list_start keeps moving to the end of the list and 
- * then back again so the list remains circular.
- */
-static void add_to_front(block_t* block, size_t place_index)
-{
-    /* If list is empty then make block the start of it */
-        if(free_list_start[place_index] == NULL)
-        {
-            free_list_start[place_index] = block;
-            free_list_start[place_index] -> next = block;
-            free_list_start[place_index] -> prev = block;
-        }
-        /* otherwise add it to before the free_list_start */
-        else
-        {
-            block -> next = free_list_start[place_index];
-            block -> prev = free_list_start[place_index] -> prev; 
-            free_list_start[place_index] -> prev -> next  = block;
-            free_list_start[place_index] -> prev = block;
-        }
-        return;
+    dbg_ensures(mm_checkheap(__LINE__));
+    return header_to_payload(block);
 }
 
-/* Takes in a pointer to free block and list index of that block then 
- * removes it from the repective free list 
+/*
+ * POSIX form of memalign: the alignment must also be a multiple of
+ * sizeof(void *). Stores the payload in *memptr and returns 0, or returns
+ * EINVAL or ENOMEM and leaves *memptr alone.
  */
-static void change_connections(block_t* block, size_t change_index)
+int posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-    /* If there is only one block in the free list then make list empty */
-    if(block -> prev == block && block-> next == block)
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0
+        || alignment % sizeof(void *) != 0)
     {
-        free_list_start[change_index] = NULL;
+        return EINVAL;
     }
-    else
+
+    void *bp = memalign(alignment, size);
+    if (bp == NULL && size != 0)
     {
-        /* If block is the start of the list 
-         * then move the start to next block
-         */
-        if(block == free_list_start[change_index])
-        {
-            free_list_start[change_index] = block -> next;
-        }
-        /* remove the block */
-        block -> next -> prev = block -> prev;
-        block -> prev -> next = block -> next;
+        return ENOMEM;
     }
-    
-    return;
+    *memptr = bp;
+    return 0;
 }
 
-
 /*
- * Takes in pointer to a free block and then tries 
- * to merge it with adjacent free blocks if possible. 
- * If a merge is possible it first removes the free block from its free_list
+ * C11 form of memalign. Any size is accepted, as C17 allows.
  */
-static block_t *coalesce(block_t * block) 
+void *aligned_alloc(size_t alignment, size_t size)
 {
-    block_t *block_next = find_next(block);
-    block_t *block_prev = find_prev(block);
+    return memalign(alignment, size);
+}
 
-    bool prev_alloc = extract_alloc(*(find_prev_footer(block)));
-    bool next_alloc = get_alloc(block_next);
-    size_t size = get_size(block);
+/*
+ * Takes a payload pointer from malloc and returns how many bytes it can
+ * hold, which may be more than were asked for; 0 for NULL. A buffer may
+ * grow into those bytes without calling realloc, and realloc up to that
+ * size returns the same pointer without copying.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return 0;
+    }
+    return get_usable_size(ptr);
+}
 
-    size_t merge_index;
-    merge_index = find_best_index(size);
+/*
+ * Takes in a payload size, a count n and an array of n pointers, and
+ * fills the array with n new blocks of that size. They are carved in a
+ * row out of one free region: one list removal and one split for the
+ * whole batch. Small sizes, which take slab slots, and huge ones, which
+ * are mapped, are allocated one by one. Returns how many pointers were
+ * filled; on failure the rest of the array is left NULL.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs)
+{
+    dbg_requires(mm_checkheap(__LINE__));
 
-    if (prev_alloc && next_alloc)              // Case 1
+    if (heap_start == NULL)
     {
-        add_to_front(block, merge_index);
-        
-        return block;
+        mm_init();
     }
-
-    else if (prev_alloc && !next_alloc)        // Case 2
+    for (size_t i = 0; i < n; i++)
     {
-        /* restore connections before splice */
-        size_t next_size = get_size(block_next);
-        size_t next_index = find_best_index(next_size);
-        change_connections(block_next, next_index);
-
-        size += get_size(block_next);
-        write_header(block, size, false);
-        write_footer(block, size, false);
-
-        /* add the new bigger block to the free list */
-        size_t merge_index = find_best_index(size);
-        add_to_front(block, merge_index);
+        ptrs[i] = NULL;
+    }
+    if (size == 0 || n == 0)
+    {
+        return 0;
     }
 
-    else if (!prev_alloc && next_alloc)        // Case 3
+    if (size <= slab_max || size > map_threshold - hsize)
     {
-        /* restore connections before splice */
-        size_t prev_size = get_size(block_prev);
-        size_t prev_index = find_best_index(prev_size);
-        change_connections(block_prev, prev_index);
+        size_t filled = 0;
+        while (filled < n && (ptrs[filled] = malloc(size)) != NULL)
+        {
+            filled++;
+        }
+        return filled;
+    }
 
-        /* write header and footer for new merged block */
-        size += get_size(block_prev);
-        write_header(block_prev, size, false);
-        write_footer(block_prev, size, false);
-        block = block_prev;
+    size_t asize = max(round_up(size + hsize, dsize), min_block_size);
+    if (asize * n / n != asize)
+    {
+        return 0;
+    }
+    size_t total = asize * n;
 
-        /* add the new bigger block to the free list */
-        size_t merge_index = find_best_index(size);
-        add_to_front(block, merge_index);
+    block_t *block = find_seg_fit(total);
+    if (block == NULL && quick_bytes > 0)
+    {
+        consolidate_quick_bins();
+        block = find_seg_fit(total);
+    }
+    if (block == NULL)
+    {
+        block = grow_heap(total);
+        if (block == NULL)
+        {
+            // Past heap_max malloc maps the blocks one at a time
+            size_t filled = 0;
+            while (filled < n && (ptrs[filled] = malloc(size)) != NULL)
+            {
+                filled++;
+            }
+            return filled;
+        }
     }
 
-    else                                        // Case 4
+    /* One allocated block of the whole batch, then cut into n blocks.
+     * The last one keeps whatever place did not split off. */
+    place(block, total);
+    size_t rest = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+    bool prev_mini = get_prev_mini(block);
+    for (size_t i = 0; i < n; i++)
     {
-        /* restore connections before splice */
-        size_t next_size = get_size(block_next);
-        size_t next_index = find_best_index(next_size);
-        change_connections(block_next, next_index);
+        size_t bsize = (i == n - 1) ? rest : asize;
+        write_header(block, bsize, true, prev_alloc, prev_mini);
+        ptrs[i] = header_to_payload(block);
+        rest -= bsize;
+        prev_alloc = true;
+        prev_mini = is_mini(bsize);
+        if (i < n - 1)
+        {
+            block = find_next(block);
+        }
+    }
+    write_next_prev_bits(block);
 
-        size_t prev_size = get_size(block_prev);
-        size_t prev_index = find_best_index(prev_size);
-        change_connections(block_prev, prev_index);
-         
+    dbg_ensures(mm_checkheap(__LINE__));
+    return n;
+}
+
+/*
+ * Takes in an array of n pointers from malloc (NULLs are skipped) and
+ * frees them all. The array is sorted by address, then each run of
+ * blocks lying back to back in the heap is turned into one free block
+ * and coalesced once, instead of once per block. Slab slots are freed
+ * one by one. The order of ptrs is not preserved.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    qsort(ptrs, n, sizeof(*ptrs), compare_addresses);
+
+    size_t i = 0;
+    while (i < n)
+    {
+        if (ptrs[i] == NULL)
+        {
+            i++;
+            continue;
+        }
+        run_t *run = find_run(ptrs[i]);
+        if (run != NULL)
+        {
+            slab_free(run, ptrs[i]);
+            i++;
+            continue;
+        }
+
+        block_t *block = payload_to_header(ptrs[i]);
+        if (is_mapped(block))
+        {
+            unmap_block(block);
+            i++;
+            continue;
+        }
+        block_t *last = block;
+        size_t size = get_size(block);
+        for (i++; i < n; i++)
+        {
+            block_t *next = payload_to_header(ptrs[i]);
+            if (next != find_next(last) || find_run(ptrs[i]) != NULL)
+            {
+                break;
+            }
+            size += get_size(next);
+            last = next;
+        }
+
+        write_header(block, size, false, get_prev_alloc(block),
+                     get_prev_mini(block));
+        write_footer(block, size);
+        trim_heap(coalesce(block));
+    }
+    dbg_ensures(mm_checkheap(__LINE__));
+}
+
+/*
+ * Takes in an object size and returns a new, empty pool handing out
+ * objects of that size, or NULL. Slots are the size rounded up to wsize
+ * with no header, and are wsize aligned, or dsize aligned when the slot
+ * size is a multiple of dsize: a type's size is a multiple of its
+ * alignment, so that is enough for any object of the size.
+ */
+mm_pool_t *mm_pool_create(size_t size)
+{
+    mm_pool_t *pool = malloc(sizeof(mm_pool_t));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    pool -> slot_size = round_up(max(size, 1), wsize);
+    pool -> free_slots = NULL;
+    pool -> bump = NULL;
+    pool -> bump_end = NULL;
+    pool -> chunks = NULL;
+    pool -> chunk_size = max(pool_chunk_min, dsize + pool -> slot_size);
+    return pool;
+}
+
+/*
+ * Takes in a pool and returns one of its free slots, or NULL if no chunk
+ * could be allocated. The slot last freed comes back first.
+ */
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    void *slot = pool -> free_slots;
+    if (slot != NULL)
+    {
+        pool -> free_slots = *(void **)slot;
+        return slot;
+    }
+
+    if ((size_t)(pool -> bump_end - pool -> bump) < pool -> slot_size
+        && !pool_grow(pool))
+    {
+        return NULL;
+    }
+    slot = pool -> bump;
+    pool -> bump += pool -> slot_size;
+    return slot;
+}
+
+/*
+ * Takes in a pool and a slot from mm_pool_alloc on it (or NULL) and
+ * pushes the slot on the pool's free slots.
+ */
+void mm_pool_free(mm_pool_t *pool, void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+    *(void **)ptr = pool -> free_slots;
+    pool -> free_slots = ptr;
+}
+
+/*
+ * Takes in a pool (or NULL) and frees it along with every chunk, so all
+ * its objects, freed or not, are gone at once.
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    void *chunk = pool -> chunks;
+    while (chunk != NULL)
+    {
+        void *next = *(void **)chunk;
+        free(chunk);
+        chunk = next;
+    }
+    free(pool);
+    dbg_ensures(mm_checkheap(__LINE__));
+}
+
+/*
+ * Returns a new, empty arena, or NULL. An arena hands out memory by
+ * bumping a pointer through chunks from the heap, and only gives it back
+ * all at once, through mm_arena_reset or mm_arena_destroy.
+ */
+mm_arena_t *mm_arena_create(void)
+{
+    mm_arena_t *arena = malloc(sizeof(mm_arena_t));
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    arena -> bump = NULL;
+    arena -> bump_end = NULL;
+    arena -> chunks = NULL;
+    arena -> chunk_size = arena_chunk_min;
+    return arena;
+}
+
+/*
+ * Takes in an arena and a size, and returns a dsize aligned payload of at
+ * least that size from the arena, or NULL if size is 0 or no chunk could
+ * be allocated.
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    if (size == 0)
+    {
+        return NULL;
+    }
+    if (size > arena_large)
+    {
+        return arena_alloc_large(arena, size);
+    }
+
+    size_t asize = round_up(size, dsize);
+    if ((size_t)(arena -> bump_end - arena -> bump) < asize)
+    {
+        char *chunk = malloc(max(arena -> chunk_size, dsize + asize));
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        *(void **)chunk = arena -> chunks;
+        arena -> chunks = chunk;
+        arena -> bump = chunk + dsize;
+        arena -> bump_end = chunk + get_usable_size(chunk);
+        if (2 * arena -> chunk_size <= arena_chunk_max)
+        {
+            arena -> chunk_size *= 2;
+        }
+    }
+
+    void *bp = arena -> bump;
+    arena -> bump += asize;
+    return bp;
+}
+
+/*
+ * Takes in an arena and frees everything allocated from it, with one free
+ * call per chunk. The arena is left empty, as from mm_arena_create: a
+ * chunk kept back would hold the peak of one phase through the next.
+ */
+void mm_arena_reset(mm_arena_t *arena)
+{
+    void *chunk = arena -> chunks;
+    while (chunk != NULL)
+    {
+        void *next = *(void **)chunk;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena -> bump = NULL;
+    arena -> bump_end = NULL;
+    arena -> chunks = NULL;
+    arena -> chunk_size = arena_chunk_min;
+    dbg_ensures(mm_checkheap(__LINE__));
+}
+
+/*
+ * Takes in an arena (or NULL) and frees it along with every chunk.
+ */
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+    mm_arena_reset(arena);
+    free(arena);
+}
+
+/*
+ * Takes in a size and returns a new, unlocked handle to an object of that
+ * size, or NULL. The object takes a block of the heap, or a region of its
+ * own over map_threshold, which never moves.
+ */
+mm_handle_t *mm_halloc(size_t size)
+{
+    dbg_requires(mm_checkheap(__LINE__));
+
+    if (heap_start == NULL)
+    {
+        mm_init();
+    }
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    size_t asize = max(round_up(size + hsize, dsize), min_block_size);
+    block_t *block = NULL;
+    if (asize <= map_threshold)
+    {
+        block = heap_alloc(asize);
+    }
+    if (block == NULL)
+    {
+        block = map_block(asize);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    mm_handle_t *handle = new_handle();
+    if (handle == NULL)
+    {
+        free(header_to_payload(block));
+        return NULL;
+    }
+    handle -> ptr = header_to_payload(block);
+    handle -> locks = 0;
+    num_handles++;
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    return handle;
+}
+
+/*
+ * Takes in a handle and returns where its object is, or NULL for a NULL
+ * handle. The object stays there until as many mm_hunlock calls have
+ * been made on the handle as mm_hlock calls.
+ */
+void *mm_hlock(mm_handle_t *handle)
+{
+    if (handle == NULL)
+    {
+        return NULL;
+    }
+    handle -> locks++;
+    return handle -> ptr;
+}
+
+/*
+ * Takes in a handle locked by mm_hlock and undoes one lock on it.
+ */
+void mm_hunlock(mm_handle_t *handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+    dbg_requires(handle -> locks > 0);
+    handle -> locks--;
+}
+
+/*
+ * Takes in a handle (or NULL) and frees it along with its object, locked
+ * or not. During a compaction pass its place in compact_order is cleared,
+ * so that the pass does not move whatever the handle is reused for.
+ */
+void mm_hfree(mm_handle_t *handle)
+{
+    if (handle == NULL)
+    {
+        return;
+    }
+
+    if (compact_order != NULL && handle -> order >= compact_next
+        && handle -> order < compact_count
+        && compact_order[handle -> order] == handle)
+    {
+        compact_order[handle -> order] = NULL;
+    }
+    free(handle -> ptr);
+    handle -> ptr = NULL;
+    handle -> next_free = free_handles;
+    free_handles = handle;
+    num_handles--;
+}
+
+/*
+ * Takes in a byte budget and compacts the heap by about that much. A pass
+ * goes through the live handles in address order, and moves each object
+ * not locked to a lower address: it slides down over a free block just
+ * below it, leaving that space above it to merge with any free block
+ * there, or else it is copied to a free block lower in the heap that
+ * fits it. Once the last handle of the pass is done, the free block ending
+ * the heap is trimmed down to trim_pad bytes. A call moves objects until
+ * budget bytes have been copied; returns true if it ended the pass, or
+ * false if the next call goes on with it. Handles made since the pass
+ * began, even in the slot of one freed since, wait for the next one.
+ */
+bool mm_hcompact(size_t budget)
+{
+    dbg_requires(mm_checkheap(__LINE__));
+
+    if (heap_start == NULL)
+    {
+        mm_init();
+    }
+    if (compact_order == NULL)
+    {
+        begin_compaction();
+    }
+
+    size_t moved = 0;
+    while (compact_next < compact_count && moved < budget)
+    {
+        moved += move_handle(compact_order[compact_next++]);
+    }
+    if (compact_next < compact_count)
+    {
+        dbg_ensures(mm_checkheap(__LINE__));
+        return false;
+    }
+
+    if (compact_order != NULL)
+    {
+        mem_unmap(compact_order);
+    }
+    compact_order = NULL;
+    compact_count = 0;
+    compact_next = 0;
+
+    block_t *epilogue = (block_t *)((char *)mem_heap_hi() + 1 - hsize);
+    if (!get_prev_alloc(epilogue))
+    {
+        block_t *last = find_prev(epilogue);
+        if (get_size(last) > trim_pad)
+        {
+            shrink_heap(last);
+        }
+    }
+
+    dbg_ensures(mm_checkheap(__LINE__));
+    return true;
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+/*
+ * Takes in size and then increases heap size accordingly rounding it to dsize
+ */
+static block_t *extend_heap(size_t size) 
+{
+    void *bp;
+
+    // Allocate an even number of words to maintain alignment, and never
+    // past heap_max
+    size = round_up(size, dsize);
+    if (size > heap_max - mem_heapsize()
+        || (bp = mem_sbrk(size)) == (void *)-1)
+    {
+        return NULL;
+    }
+
+   
+    // Initialize free block header/footer over the old epilogue, which
+    // already records whether the last block is allocated
+    block_t *block =  payload_to_header(bp);
+  
+    write_header(block, size, false, get_prev_alloc(block),
+                 get_prev_mini(block));
+   
+    write_footer(block, size);
+
+    // Create new epilogue header
+    block_t *block_next = find_next(block);
+    write_header(block_next, 0, true, false, false);
+
+    // New memory below memlib's zero start may hold old data
+    char *dirty_end = (char *)mem_zero_start();
+    if (dirty_end > (char *)bp)
+    {
+        dirty_end = dirty_end < (char *)block_next ? dirty_end
+                                                   : (char *)block_next;
+        zero_start = dirty_end > zero_start ? dirty_end : zero_start;
+    }
+
+    // Coalesce in case the previous block was free
+    return coalesce(block);
+}
+
+/*
+ * Takes in the adjusted size of a request no free block fits and grows
+ * the heap as growth_policy says. Returns the free block at the end of
+ * the heap, of at least asize bytes, or NULL if the heap cannot grow.
+ */
+static block_t *grow_heap(size_t asize)
+{
+    if (growth_policy == GROWTH_FIXED)
+    {
+        return extend_heap(max(asize, chunksize));
+    }
+
+    // Only what the free block at the end of the heap lacks is needed
+    block_t *epilogue = (block_t *)((char *)mem_heap_hi() + 1 - hsize);
+    size_t need = asize;
+    if (!get_prev_alloc(epilogue))
+    {
+        size_t tail = get_size(find_prev(epilogue));
+        need = tail < asize ? asize - tail : 0;
+    }
+
+    size_t step = round_up(mem_heapsize() >> growth_shift, dsize);
+    step = step < grow_step ? max(step, chunksize) : grow_step;
+    size_t size = max(need, step);
+    block_t *block = extend_heap(size);
+    if (block == NULL && size > need && need > 0)
+    {
+        // Near the heap limit, settle for an exact fit
+        block = extend_heap(need);
+    }
+    if (block != NULL && size > need)
+    {
+        grow_step = grow_step < growth_max / 2 ? 2 * grow_step : growth_max;
+    }
+    return block;
+}
+
+/* Takes in a pointer to a free block and free list index for 
+ * that block then Adds the free block to the place before free_list_start. 
+ * The free_list_start keeps moving to the end of the list and 
+ * then back again so the list remains circular.
+ */
+static void add_to_front(block_t* block, size_t place_index)
+{
+    /* If list is empty then make block the start of it */
+        if(free_list_start[place_index] == NULL)
+        {
+            set_list_bit(place_index, true);
+            free_list_start[place_index] = block;
+            block -> next = make_link(block);
+            block -> prev = make_link(block);
+        }
+        /* otherwise add it to before the free_list_start */
+        else
+        {
+            link_before(block, free_list_start[place_index]);
+        }
+        return;
+}
+
+/* Takes in a pointer to a free block and free list index for that block
+ * and links it in before the first block of higher address, keeping
+ * free_list_start the lowest. Blocks past the tail, which is where
+ * extend_heap puts new space, are appended without a walk.
+ */
+static void add_in_order(block_t *block, size_t place_index)
+{
+    block_t *start = free_list_start[place_index];
+
+    if (start == NULL || block > get_link(start -> prev))
+    {
+        add_to_front(block, place_index);
+        return;
+    }
+
+    block_t *next = start;
+    while (next < block)
+    {
+        next = get_link(next -> next);
+    }
+    link_before(block, next);
+    if (next == start)
+    {
+        free_list_start[place_index] = block;
+    }
+}
+
+/* Links block into a non-empty free list just before next */
+static void link_before(block_t *block, block_t *next)
+{
+    block -> next = make_link(next);
+    block -> prev = next -> prev;
+    get_link(next -> prev) -> next = make_link(block);
+    next -> prev = make_link(block);
+}
+
+/*
+ * Under address order, lets block, about to become a free block of the
+ * given size, take the list place of old, a free neighbour being merged
+ * into it. No other free block lies between two neighbours, so the order
+ * holds as long as both sizes map to the same segregated list. Returns
+ * false (and changes nothing) otherwise; the caller then removes old and
+ * inserts block as usual.
+ */
+static bool keep_list_place(block_t *old, block_t *block, size_t size)
+{
+    if (placement_policy != PLACEMENT_ADDRESS_ORDERED)
+    {
+        return false;
+    }
+
+    size_t old_size = get_size(old);
+    if (is_mini(old_size) || old == wilderness
+        || get_size((block_t *)((char *)block + size)) == 0)
+    {
+        return false;
+    }
+    size_t index = find_best_index(old_size);
+    if (index >= tree_index || index != find_best_index(size))
+    {
+        return false;
+    }
+
+    if (old != block)
+    {
+        if (get_link(old -> next) == old)
+        {
+            block -> next = make_link(block);
+            block -> prev = make_link(block);
+        }
+        else
+        {
+            block -> next = old -> next;
+            block -> prev = old -> prev;
+            get_link(old -> prev) -> next = make_link(block);
+            get_link(old -> next) -> prev = make_link(block);
+        }
+        if (free_list_start[index] == old)
+        {
+            free_list_start[index] = block;
+        }
+    }
+    return true;
+}
+
+/* Takes in a pointer to free block and list index of that block then 
+ * removes it from the repective free list 
+ */
+static void change_connections(block_t* block, size_t change_index)
+{
+    /* If there is only one block in the free list then make list empty */
+    block_t *next = get_link(block -> next);
+    if(next == block)
+    {
+        free_list_start[change_index] = NULL;
+        set_list_bit(change_index, false);
+    }
+    else
+    {
+        /* If block is the start of the list 
+         * then move the start to next block
+         */
+        if(block == free_list_start[change_index])
+        {
+            free_list_start[change_index] = next;
+        }
+        /* remove the block */
+        next -> prev = block -> prev;
+        get_link(block -> prev) -> next = block -> next;
+    }
+    
+    return;
+}
+
+/* Takes in a pointer to a free block and adds it to the list for its size:
+ * the mini list for mini blocks, free_tree for blocks above tree_min and
+ * the matching segregated list otherwise. A block ending the heap becomes
+ * the wilderness instead.
+ */
+static void insert_free_block(block_t *block)
+{
+    size_t size = get_size(block);
+
+    if (is_mini(size))
+    {
+        hword_t flags = block -> header & (prev_alloc_mask | prev_mini_mask);
+        block -> header = flags | mini_free_mask;
+        block -> next = make_link(mini_free_list);
+        if (mini_free_list != NULL)
+        {
+            mini_free_list -> header =
+                (mini_free_list -> header & ~size_mask)
+                | (hword_t)(word_t)header_to_payload(block);
+        }
+        mini_free_list = block;
+        return;
+    }
+    if (get_size(find_next(block)) == 0)
+    {
+        wilderness = block;
+        return;
+    }
+    size_t index = find_best_index(size);
+    if (index >= tree_index)
+    {
+        tree_insert(block);
+        return;
+    }
+    if (placement_policy == PLACEMENT_ADDRESS_ORDERED)
+    {
+        add_in_order(block, index);
+        return;
+    }
+    add_to_front(block, index);
+}
+
+/* Takes in a pointer to a free block and removes it from the list for its
+ * size. A free mini block finds its prev link in its own header.
+ */
+static void remove_free_block(block_t *block)
+{
+    size_t size = get_size(block);
+
+    if (is_mini(size))
+    {
+        void *prev_bp = (void *)(word_t)(block -> header & size_mask);
+        block_t *next = get_link(block -> next);
+        if (prev_bp == NULL)
+        {
+            mini_free_list = next;
+        }
+        else
+        {
+            payload_to_header(prev_bp) -> next = block -> next;
+        }
+        if (next != NULL)
+        {
+            next -> header = (next -> header & ~size_mask)
+                             | (hword_t)(word_t)prev_bp;
+        }
+        return;
+    }
+    if (block == wilderness)
+    {
+        wilderness = NULL;
+        return;
+    }
+    size_t index = find_best_index(size);
+    if (index >= tree_index)
+    {
+        tree_remove(block);
+        return;
+    }
+    change_connections(block, index);
+}
+
+
+/*
+ * Takes in pointer to a free block and then tries 
+ * to merge it with adjacent free blocks if possible. 
+ * If a merge is possible it first removes the free block from its free_list
+ * The previous block is only located (through its footer, or by the
+ * prev_mini bit) when the prev_alloc bit says it is free. The block after
+ * the result is told that its predecessor is free, and whether it is mini.
+ * Under address order the result takes over a merged neighbour's list
+ * place when it can (see keep_list_place), skipping the ordered insert.
+ */
+static block_t *coalesce(block_t * block) 
+{
+    block_t *block_next = find_next(block);
+    block_t *block_prev = NULL;
+
+    bool prev_alloc = get_prev_alloc(block);
+    bool next_alloc = get_alloc(block_next);
+    size_t size = get_size(block);
+
+    if (!prev_alloc)
+    {
+        block_prev = find_prev(block);
+    }
+
+    if (prev_alloc && next_alloc)              // Case 1
+    {
+        insert_free_block(block);
+    }
+
+    else if (prev_alloc && !next_alloc)        // Case 2
+    {
+        size_t next_size = get_size(block_next);
+        bool kept = keep_list_place(block_next, block, size + next_size);
+
+        /* restore connections before splice */
+        if (!kept)
+        {
+            remove_free_block(block_next);
+        }
+
+        size += next_size;
+        write_header(block, size, false, true, get_prev_mini(block));
+        write_footer(block, size);
+        clear_boundary(block, block_next);
+
+        /* add the new bigger block to the free list */
+        if (!kept)
+        {
+            insert_free_block(block);
+        }
+    }
+
+    else if (!prev_alloc && next_alloc)        // Case 3
+    {
+        size += get_size(block_prev);
+        bool kept = keep_list_place(block_prev, block_prev, size);
+
+        /* restore connections before splice */
+        if (!kept)
+        {
+            remove_free_block(block_prev);
+        }
+
+        /* write header and footer for new merged block */
+        write_header(block_prev, size, false, get_prev_alloc(block_prev),
+                     get_prev_mini(block_prev));
+        write_footer(block_prev, size);
+        clear_boundary(block_prev, block);
+        block = block_prev;
+
+        /* add the new bigger block to the free list */
+        if (!kept)
+        {
+            insert_free_block(block);
+        }
+    }
+
+    else                                        // Case 4
+    {
         size += get_size(block_next) + get_size(block_prev);
-        write_header(block_prev, size, false);
-        write_footer(block_prev, size, false);
+        bool kept = keep_list_place(block_prev, block_prev, size);
+
+        /* restore connections before splice */
+        remove_free_block(block_next);
+        if (!kept)
+        {
+            remove_free_block(block_prev);
+        }
+         
+        write_header(block_prev, size, false, get_prev_alloc(block_prev),
+                     get_prev_mini(block_prev));
+        write_footer(block_prev, size);
+        clear_boundary(block_prev, block);
+        clear_boundary(block_prev, block_next);
         block = block_prev;
 
-        /* add the new bigger block to the free list */
-        size_t merge_index = find_best_index(size);
-        add_to_front(block, merge_index);
+        /* add the new bigger block to the free list */
+        if (!kept)
+        {
+            insert_free_block(block);
+        }
+    }
+    write_next_prev_bits(block);
+    return block;
+}
+
+/*
+ * Takes in a block being coalesced, with its merged size already in its
+ * header, and a free neighbour above it merged into it. The neighbour's
+ * header and links, and the footer below them, are now payload: those at
+ * or past zero_start are cleared, leaving out the merged block's own
+ * header, links and footer.
+ */
+static void clear_boundary(block_t *block, block_t *upper)
+{
+    char *hi = (char *)upper + sizeof(block_t);
+    if (hi <= zero_start)
+    {
+        return;
+    }
+
+    char *footer = (char *)find_next(block) - hsize;
+    hi = hi < footer ? hi : footer;
+
+    char *lo = (char *)upper - hsize;
+    char *links_end = (char *)block + sizeof(block_t);
+    lo = lo > zero_start ? lo : zero_start;
+    lo = lo > links_end ? lo : links_end;
+    if (lo < hi)
+    {
+        memset(lo, 0, (size_t)(hi - lo));
+    }
+}
+
+/*
+ * Takes in a block just allocated out of free memory and moves zero_start
+ * past it, remembering the old value in last_zero_start.
+ */
+static void mark_dirty(block_t *block)
+{
+    char *end = (char *)find_next(block);
+
+    last_zero_start = zero_start;
+    if (end > zero_start)
+    {
+        zero_start = end;
+    }
+}
+
+/*
+ * Takes in ponter to free block and its size then
+ * markes the header of the block as allocated, 
+ * inserts size in header and attemps to recycle unused 
+ * part of the free block. Allocated blocks get no footer; the block
+ * after them records the allocation in its prev_alloc bit instead.
+ */
+static void place(block_t *block, size_t asize)
+{
+    size_t csize = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+    bool prev_mini = get_prev_mini(block);
+
+    remove_free_block(block);
+
+    if ((csize - asize) >= min_block_size)
+    {
+        block_t *block_next;
+        write_header(block, asize, true, prev_alloc, prev_mini);
+
+        block_next = find_next(block);
+        write_header(block_next, csize-asize, false, true,
+                     is_mini(asize));
+        write_footer(block_next, csize-asize);
+        insert_free_block(block_next);
+        write_next_prev_bits(block_next);
+    }
+    else
+    { 
+        write_header(block, csize, true, prev_alloc, prev_mini);
+        write_next_prev_bits(block);
+    }
+    mark_dirty(block);
+}
+
+/*
+ * Takes in an allocated block and a smaller or equal adjusted size. If the
+ * rest is big enough to be a block of its own, it is split off the end
+ * and freed, merging with a free block after it.
+ */
+static void split_allocated(block_t *block, size_t asize)
+{
+    size_t csize = get_size(block);
+
+    if ((csize - asize) < min_block_size)
+    {
+        return;
+    }
+    write_header(block, asize, true, get_prev_alloc(block),
+                 get_prev_mini(block));
+
+    block_t *block_next = find_next(block);
+    write_header(block_next, csize-asize, false, true,
+                 is_mini(asize));
+    write_footer(block_next, csize-asize);
+    coalesce(block_next);
+}
+
+/*
+ * Takes in an allocated block and the adjusted size realloc wants for it,
+ * and tries to give it that size using only the blocks around it.
+ * Shrinking always works. Growing first absorbs the next block when it is
+ * free and big enough; if the block, or the free block after it, ends the
+ * heap, the heap is extended by just the missing bytes first. Failing
+ * that, and if no free block elsewhere fits, it absorbs a free previous
+ * block big enough for the growth (and a free next one) and slides the
+ * payload down into it.
+ * Returns the resized block, or NULL if realloc has to move it elsewhere,
+ * leaving it untouched.
+ */
+static block_t *resize_in_place(block_t *block, size_t asize)
+{
+    size_t csize = get_size(block);
+
+    if (asize <= csize)
+    {
+        split_allocated(block, asize);
+        return block;
+    }
+
+    block_t *block_next = find_next(block);
+    size_t avail = csize;
+    if (!get_alloc(block_next))
+    {
+        avail += get_size(block_next);
+    }
+    bool at_end = get_size(block_next) == 0
+                  || (!get_alloc(block_next)
+                      && get_size(find_next(block_next)) == 0);
+
+    // At the end of the heap, grow it by only what is missing
+    if (avail < asize && at_end)
+    {
+        if (extend_heap(asize - avail) == NULL)
+        {
+            return NULL;
+        }
+        block_next = find_next(block);
+        avail = csize + get_size(block_next);
+    }
+
+    // Slide down into a free previous block, but only when no free block
+    // elsewhere fits: moving there keeps the merged hole for later requests.
+    // It must cover the growth on its own; one that only does so with the
+    // next block is usually too small to be worth the copy
+    if (avail < asize && !get_prev_alloc(block)
+        && find_seg_fit(asize) == NULL)
+    {
+        block_t *block_prev = find_prev(block);
+        size_t prev_size = get_size(block_prev);
+        if (prev_size >= asize - csize)
+        {
+            size_t payload_size = get_payload_size(block);
+
+            remove_free_block(block_prev);
+            if (!get_alloc(block_next))
+            {
+                remove_free_block(block_next);
+            }
+            write_header(block_prev, prev_size + avail, true,
+                         get_prev_alloc(block_prev),
+                         get_prev_mini(block_prev));
+            memmove(header_to_payload(block_prev), header_to_payload(block),
+                    payload_size);
+            write_next_prev_bits(block_prev);
+            mark_dirty(block_prev);
+            split_allocated(block_prev, asize);
+            return block_prev;
+        }
+    }
+
+    if (get_alloc(block_next) || avail < asize)
+    {
+        return NULL;
+    }
+
+    remove_free_block(block_next);
+    write_header(block, avail, true, get_prev_alloc(block),
+                 get_prev_mini(block));
+    write_next_prev_bits(block);
+    mark_dirty(block);
+    split_allocated(block, asize);
+    return block;
+}
+
+/*
+ * Takes in an adjusted size and returns a free block of at least that
+ * many bytes, or NULL. The wilderness is only used when no block on the
+ * lists or in the tree fits.
+ */
+static block_t *find_seg_fit(size_t asize)
+{
+    block_t *block = find_list_fit(asize);
+
+    if (block == NULL && wilderness != NULL && get_size(wilderness) >= asize)
+    {
+        block = wilderness;
+    }
+    return block;
+}
+
+/*
+ * Takes in size of allocation then finds a suitable list 
+ * for that size.  It then returns a pointer to a free block 
+ * of a size grater then or equal to asize.
+ * Free mini blocks only satisfy mini requests and are kept apart.
+ * Only the list asize maps to needs a walk, since it also holds blocks
+ * smaller than asize. Every block in a higher list is big enough, so the
+ * first non-empty one is picked straight from free_list_bitmap.
+ * Requests above tree_min, and any that reach the tree's bit, take the
+ * best fit from free_tree.
+ */
+static block_t *find_list_fit(size_t asize)
+{
+    /* Mini requests take any free mini block before splitting a bigger one */
+    if (is_mini(asize) && mini_free_list != NULL)
+    {
+        return mini_free_list;
+    }
+
+    size_t min_start_index = find_best_index(asize);
+    if (min_start_index >= tree_index)
+    {
+        return tree_find_fit(asize);
+    }
+
+    block_t *block = free_list_start[min_start_index];
+
+    if(block != NULL)
+    {
+        do
+        {
+            if (asize <= get_size(block))
+            {
+                return block;
+            }
+            block = get_link(block -> next);
+        } while (block != free_list_start[min_start_index]);
+    }
+
+    /* Non-empty lists strictly above min_start_index */
+    size_t start_index = min_start_index + 1;
+    size_t word = start_index / 64;
+    word_t larger = 0;
+    if (word < BITMAP_WORDS)
+    {
+        larger = free_list_bitmap[word] & (~(word_t)0 << (start_index % 64));
+    }
+    while (larger == 0)
+    {
+        if (++word >= BITMAP_WORDS)
+        {
+            return NULL; // no fit found
+        }
+        larger = free_list_bitmap[word];
+    }
+    size_t index = word * 64 + find_first_set(larger);
+    if (index == tree_index)
+    {
+        return tree_find_fit(asize);
+    }
+    return free_list_start[index];
+}
+
+/*
+ * Takes in a payload pointer and returns the run its slot belongs to, or
+ * NULL if it is the payload of an ordinary block. Runs are told apart by
+ * page_map alone, never by reading memory near bp.
+ */
+static run_t *find_run(void *bp)
+{
+    unsigned char *entry = find_page_entry(bp, false);
+
+    if (entry == NULL || *entry == 0)
+    {
+        return NULL;
+    }
+    return (run_t *)(run_base + (((size_t)((char *)bp - run_base) >> run_shift)
+                                 << run_shift));
+}
+
+/*
+ * Takes in an address and returns its window's entry in page_map. If the
+ * window has no leaf yet, one is mapped when create is set; otherwise, or
+ * if that fails or the window lies past the root, NULL is returned.
+ */
+static unsigned char *find_page_entry(void *bp, bool create)
+{
+    size_t window = (size_t)((char *)bp - run_base) >> run_shift;
+    size_t root = window / PAGE_LEAF_SIZE;
+
+    if (root >= PAGE_MAP_ROOTS)
+    {
+        return NULL;
+    }
+    if (page_map[root] == NULL)
+    {
+        if (!create)
+        {
+            return NULL;
+        }
+        page_map[root] = mem_map(PAGE_LEAF_SIZE);
+        if (page_map[root] == NULL)
+        {
+            return NULL;
+        }
+        memset(page_map[root], 0, PAGE_LEAF_SIZE);
+    }
+    return &page_map[root][window % PAGE_LEAF_SIZE];
+}
+
+/*
+ * Takes in a request of at most slab_max bytes and returns a free slot
+ * of its class, taken from the first partial run or from a new run.
+ * Returns NULL if no run could be made.
+ */
+static void *slab_alloc(size_t size)
+{
+    size_t slab_class = slab_class_of[(size + dsize - 1) / dsize];
+    run_t *run = partial_runs[slab_class];
+
+    if (run == NULL)
+    {
+        run = new_run(slab_class);
+        if (run == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    // A partial run has a clear bit, and bits past capacity are set
+    size_t word = 0;
+    while (run -> used_map[word] == ~(word_t)0)
+    {
+        word++;
+    }
+    size_t slot = word * 64 + find_first_set(~run -> used_map[word]);
+    run -> used_map[word] |= (word_t)1 << (slot % 64);
+
+    if (++(run -> used) == run -> capacity)
+    {
+        unlink_run(run);
+    }
+    return (char *)run + sizeof(run_t) + slot * run -> slot_size;
+}
+
+/*
+ * Takes in a run and one of its allocated slots and frees the slot. A run
+ * left empty goes straight back to the heap as an ordinary free block, so
+ * that it can coalesce; keeping one per class pinned small heaps apart.
+ */
+static void slab_free(run_t *run, void *bp)
+{
+    size_t slot = (size_t)((char *)bp - (char *)run - sizeof(run_t))
+                  / run -> slot_size;
+
+    dbg_requires((run -> used_map[slot / 64] >> (slot % 64)) & 1);
+    run -> used_map[slot / 64] &= ~((word_t)1 << (slot % 64));
+
+    if ((run -> used)-- == run -> capacity)
+    {
+        link_run(run);
+    }
+    if (run -> used == 0)
+    {
+        unlink_run(run);
+        *find_page_entry(run, false) = 0;
+        free(run);
+    }
+}
+
+/*
+ * Takes in a slab class, carves a run block for it out of the heap and
+ * returns its run, set up with every slot free and put on partial_runs.
+ * Returns NULL if the heap cannot grow, or the run would lie beyond the
+ * part of the heap page_map covers.
+ */
+static run_t *new_run(size_t slab_class)
+{
+    block_t *block = alloc_aligned_block(run_size, run_size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    run_t *run = (run_t *)header_to_payload(block);
+    unsigned char *entry = find_page_entry(run, true);
+    if (entry == NULL)
+    {
+        free(run);
+        return NULL;
+    }
+
+    run -> slot_size = slab_class_size[slab_class];
+    run -> slab_class = slab_class;
+    run -> used = 0;
+    run -> capacity = (run_size - hsize - sizeof(run_t)) / run -> slot_size;
+    for(size_t word = 0; word < 4; word++)
+    {
+        size_t first = word * 64;
+        if (run -> capacity >= first + 64)
+        {
+            run -> used_map[word] = 0;
+        }
+        else if (run -> capacity <= first)
+        {
+            run -> used_map[word] = ~(word_t)0;
+        }
+        else
+        {
+            run -> used_map[word] = ~(word_t)0 << (run -> capacity - first);
+        }
+    }
+    *entry = (unsigned char)(slab_class + 1);
+    link_run(run);
+    return run;
+}
+
+/*
+ * Takes in an adjusted size and a power of two alignment above dsize, and
+ * returns an allocated block of that size whose payload is aligned to it,
+ * or NULL. It comes from a free block with room for an aligned payload,
+ * or else from the end of the heap, which is extended by just enough to
+ * fit one after the free block already there.
+ */
+static block_t *alloc_aligned_block(size_t asize, size_t align)
+{
+    size_t fit_size = asize + align - dsize;
+    block_t *block = find_seg_fit(fit_size);
+
+    if (block == NULL && quick_bytes > 0)
+    {
+        consolidate_quick_bins();
+        block = find_seg_fit(fit_size);
+    }
+    if (block == NULL)
+    {
+        block_t *epilogue = (block_t *)((char *)mem_heap_hi() + 1 - hsize);
+        block_t *tail = get_prev_alloc(epilogue) ? epilogue
+                                                 : find_prev(epilogue);
+        char *end = (char *)round_up((size_t)tail + hsize, align) - hsize
+                    + asize;
+
+        if (end > (char *)epilogue
+            && extend_heap((size_t)(end - (char *)epilogue)) == NULL)
+        {
+            return NULL;
+        }
+        block = tail;
+    }
+    return carve_aligned_block(block, asize, align);
+}
+
+/*
+ * Takes in a free block with room for an asize block whose payload is
+ * aligned to align, takes that block out as allocated and returns the
+ * free space before and after it to the free lists. Payloads are dsize
+ * aligned, so the gap before is either empty or a block of its own.
+ */
+static block_t *carve_aligned_block(block_t *block, size_t asize,
+                                    size_t align)
+{
+    size_t size = get_size(block);
+    bool prev_alloc = get_prev_alloc(block);
+    bool prev_mini = get_prev_mini(block);
+    block_t *aligned = (block_t *)(round_up((size_t)block + hsize, align)
+                                   - hsize);
+    size_t lead = (size_t)((char *)aligned - (char *)block);
+
+    dbg_requires(lead + asize <= size);
+    remove_free_block(block);
+
+    if (lead > 0)
+    {
+        write_header(block, lead, false, prev_alloc, prev_mini);
+        write_footer(block, lead);
+        prev_alloc = false;
+        prev_mini = is_mini(lead);
+    }
+
+    write_header(aligned, asize, true, prev_alloc, prev_mini);
+    write_next_prev_bits(aligned);
+    if (lead > 0)
+    {
+        // Only now that aligned has a header, or it could pass for the end
+        insert_free_block(block);
+    }
+
+    size_t trail = size - lead - asize;
+    if (trail > 0)
+    {
+        block_t *block_next = find_next(aligned);
+        write_header(block_next, trail, false, true,
+                     is_mini(asize));
+        write_footer(block_next, trail);
+        insert_free_block(block_next);
+        write_next_prev_bits(block_next);
     }
-    return block;
+    mark_dirty(aligned);
+    return aligned;
 }
 
-/*
- * Takes in ponter to free block and its size then
- * markes the header and footer of the block as allocated, 
- * inserts size in header and attemps to recycle unused 
- * part of the free block
- */
-static void place(block_t *block, size_t asize)
+/* Takes in a run and pushes it on the partial list of its class */
+static void link_run(run_t *run)
 {
-    size_t csize = get_size(block);
-    size_t list_index = find_best_index(csize);
+    run_t *head = partial_runs[run -> slab_class];
 
-    if ((csize - asize) >= min_block_size)
+    run -> next = head;
+    run -> prev = NULL;
+    if (head != NULL)
     {
-        block_t *block_next;
-        write_header(block, asize, true);
-        write_footer(block, asize, true);
-        change_connections(block, list_index);
+        head -> prev = run;
+    }
+    partial_runs[run -> slab_class] = run;
+}
 
-        block_next = find_next(block);
-        write_header(block_next, csize-asize, false);
-        write_footer(block_next, csize-asize, false);
-        list_index = find_best_index(csize - asize);
-        add_to_front(block_next, list_index);
+/* Takes in a run and removes it from the partial list of its class */
+static void unlink_run(run_t *run)
+{
+    if (run -> prev != NULL)
+    {
+        run -> prev -> next = run -> next;
     }
     else
-    { 
-        write_header(block, csize, true);
-        write_footer(block, csize, true);
-        change_connections(block, list_index);
+    {
+        partial_runs[run -> slab_class] = run -> next;
+    }
+    if (run -> next != NULL)
+    {
+        run -> next -> prev = run -> prev;
     }
 }
 
 /*
- * Takes in size of allocation then finds a suitable list 
- * for that size.  It then returns a pointer to a free block 
- * of a size grater then or equal to asize.
+ * Takes in an allocated payload pointer and returns how many bytes it can
+ * hold: its slot size, the rest of its region, or the payload size of
+ * its block.
  */
-static block_t *find_seg_fit(size_t asize)
+static size_t get_usable_size(void *bp)
 {
-    size_t min_start_index = find_best_index(asize);
+    run_t *run = find_run(bp);
+    if (run != NULL)
+    {
+        return run -> slot_size;
+    }
+    block_t *block = payload_to_header(bp);
+    if (is_mapped(block))
+    {
+        return get_mapped_length(block) - dsize;
+    }
+    return get_payload_size(block);
+}
 
-    block_t *block;
+/*
+ * Takes in a payload calloc just got from malloc and its size, and
+ * clears the bytes of it that may not be zero. A mapped block is fresh
+ * memory. A block carved out of free memory is zero from the zero_start
+ * it found on, except for the links and footer it had while free. Any
+ * other block, and a slot, is cleared in full.
+ */
+static void clear_stale(void *bp, size_t size)
+{
+    char *start = (char *)bp;
+    char *end = start + size;
 
-    for(size_t list_index = min_start_index; 
-        list_index < NUM_LISTS; list_index++)
+    if (find_run(bp) == NULL)
     {
-        block = free_list_start[list_index];
-        if(block == NULL)
+        block_t *block = payload_to_header(bp);
+        if (is_mapped(block))
         {
-            continue;
+            return;
         }
-        if ((asize <= get_size(block)))
+        if (last_zero_start != NULL && last_zero_start < end)
+        {
+            char *clean = start + sizeof(block_t) - hsize;
+            clean = clean > last_zero_start ? clean : last_zero_start;
+            char *footer = (char *)find_next(block) - hsize;
+            if (clean < end)
             {
-                return block;
+                memset(start, 0, (size_t)(clean - start));
+                if (footer >= clean && footer < end)
+                {
+                    memset(footer, 0, (size_t)(end - footer));
+                }
+                return;
             }
+        }
+    }
+    memset(bp, 0, size);
+}
+
+/*
+ * Takes in an allocated block outside any run and its size, and frees
+ * it: into its quick bin when it is small enough, otherwise marked free,
+ * coalesced and trimmed off the heap if it ends it.
+ */
+static void release_block(block_t *block, size_t size)
+{
+    if (size <= quick_max)
+    {
+        quick_push(block, size);
+        return;
+    }
+
+    write_header(block, size, false, get_prev_alloc(block),
+                 get_prev_mini(block));
+    write_footer(block, size);
 
-        for (block = free_list_start[list_index] -> next; 
-                (block != NULL && block != free_list_start[list_index]);
-                     block = block -> next)
+    trim_heap(coalesce(block));
+}
+
+/*
+ * Takes in an adjusted size and returns an allocated block of the heap
+ * that fits it, or NULL if the heap cannot grow enough. Quick bins are
+ * merged back in before the heap is grown.
+ */
+static block_t *heap_alloc(size_t asize)
+{
+    block_t *block = find_seg_fit(asize);
+    if (block == NULL && quick_bytes > 0)
+    {
+        consolidate_quick_bins();
+        block = find_seg_fit(asize);
+    }
+    if (block == NULL)
+    {
+        block = grow_heap(asize);
+        if (block == NULL)
         {
-            if ((asize <= get_size(block)))
-            {
-                return block;
-            }
+            return NULL;
+        }
+    }
+
+    place(block, asize);
+    return block;
+}
+
+/*
+ * Takes in an adjusted size over map_threshold and returns an allocated
+ * block in a region of its own, or NULL if no region could be mapped.
+ * The region is rounded up to whole pages, and the payload gets the slack.
+ */
+static block_t *map_block(size_t asize)
+{
+    size_t length = round_up(asize + dsize - hsize, mem_pagesize());
+    word_t *region = (word_t *)mem_map(length);
+    if (region == NULL)
+    {
+        return NULL;
+    }
+
+    region[0] = length;
+    block_t *block = (block_t *)((char *)region + dsize - hsize);
+    write_header(block, 0, true, true, false);
+    return block;
+}
+
+/*
+ * Takes in a mapped block and unmaps its region.
+ */
+static void unmap_block(block_t *block)
+{
+    mem_unmap((char *)block + hsize - dsize);
+}
+
+/*
+ * Takes in an allocated block outside any run and returns whether it was
+ * mapped (see map_threshold).
+ */
+static bool is_mapped(block_t *block)
+{
+    return get_size(block) == 0;
+}
+
+/*
+ * Takes in a mapped block and returns the length of its region.
+ */
+static size_t get_mapped_length(block_t *block)
+{
+    return *(word_t *)((char *)block + hsize - dsize);
+}
+
+/*
+ * Takes in a free block that has just been coalesced. If it is the last
+ * block before the epilogue and over trim_threshold bytes, it is shrunk
+ * (see shrink_heap). Otherwise nothing is done.
+ */
+static void trim_heap(block_t *block)
+{
+    if (get_size(block) <= trim_threshold || get_size(find_next(block)) != 0)
+    {
+        return;
+    }
+    shrink_heap(block);
+}
+
+/*
+ * Takes in the free block just below the epilogue, of more than trim_pad
+ * bytes, and cuts it down to trim_pad bytes: a new epilogue is written
+ * after it and the break is moved back over the rest.
+ */
+static void shrink_heap(block_t *block)
+{
+    size_t size = get_size(block);
+
+    remove_free_block(block);
+    write_header(block, trim_pad, false, get_prev_alloc(block),
+                 get_prev_mini(block));
+    write_footer(block, trim_pad);
+    if (mem_sbrk(-(intptr_t)(size - trim_pad)) == (void *)-1)
+    {
+        write_header(block, size, false, get_prev_alloc(block),
+                     get_prev_mini(block));
+        write_footer(block, size);
+    }
+    else
+    {
+        block_t *epilogue = find_next(block);
+        write_header(epilogue, 0, true, false, false);
+        if (zero_start > (char *)epilogue)
+        {
+            zero_start = (char *)epilogue;
         }
+        grow_step = chunksize;
+    }
+    insert_free_block(block);
+}
+
+/*
+ * Takes in an allocated block of up to quick_max bytes and pushes it on
+ * the quick bin for its size, leaving its header as it is. Consolidates
+ * all bins once they hold more than quick_limit bytes.
+ */
+static void quick_push(block_t *block, size_t size)
+{
+    size_t bin = size / dsize - 1;
+
+    block -> next = make_link(quick_bins[bin]);
+    quick_bins[bin] = block;
+    quick_bytes += size;
+    if (quick_bytes > quick_limit)
+    {
+        consolidate_quick_bins();
+    }
+}
+
+/* Takes in an adjusted size of up to quick_max bytes and pops a block of
+ * exactly that size from its quick bin, or returns NULL if it is empty.
+ */
+static block_t *quick_pop(size_t asize)
+{
+    size_t bin = asize / dsize - 1;
+    block_t *block = quick_bins[bin];
+
+    if (block != NULL)
+    {
+        quick_bins[bin] = get_link(block -> next);
+        quick_bytes -= asize;
+    }
+    return block;
+}
 
+/*
+ * Empties every quick bin, freeing each block for real: it is marked free
+ * and coalesced with any free neighbours, as free() would have done.
+ */
+static void consolidate_quick_bins(void)
+{
+    for (size_t bin = 0; bin < NUM_QUICK_BINS; bin++)
+    {
+        block_t *block = quick_bins[bin];
+        while (block != NULL)
+        {
+            block_t *next = get_link(block -> next);
+            size_t size = get_size(block);
+            write_header(block, size, false, get_prev_alloc(block),
+                         get_prev_mini(block));
+            write_footer(block, size);
+            coalesce(block);
+            block = next;
+        }
+        quick_bins[bin] = NULL;
     }
-    return NULL; // no fit found
+    quick_bytes = 0;
 }
 
 /* Checks the following:
 * - All next/previous pointers are consistent,
 * - All free list pointers are between mem_heap_lo() and mem_heap_hi()
 * - All blocks in each list bucket fall within bucket size range 
+* - Under address order, each list ascends from free_list_start
+* - free_tree is a valid treap of free blocks above tree_min, and only
+*   its bit is set from tree_index up
 */
 bool check_free_list()
 {
@@ -557,8 +2627,21 @@ bool check_free_list()
 
     for(size_t index = 0; index < NUM_LISTS; index++)
     {
+        if(index >= tree_index)
+        {
+            if(free_list_start[index] != NULL || get_list_bit(index) !=
+                (index == tree_index && free_tree != NULL))
+            {
+                return false;
+            }
+            continue;
+        }
         if(free_list_start[index] == NULL)
         {
+            if(get_list_bit(index))
+            {
+                return false;
+            }
             continue;
         }
         if(*(&(free_list_start[index] -> header)) 
@@ -566,11 +2649,12 @@ bool check_free_list()
         {
             return false;
         }
-        if(free_list_start[index] -> next -> prev != free_list_start[index]) 
+        block_t *start = free_list_start[index];
+        if(get_link(get_link(start -> next) -> prev) != start) 
         {
             return false;
         } 
-        if(free_list_start[index] -> prev -> next != free_list_start[index])
+        if(get_link(get_link(start -> prev) -> next) != start)
         {
             return false;
         }
@@ -578,23 +2662,24 @@ bool check_free_list()
         {
             return false;
         }
-        if (index != 15 && 
-            (get_size(free_list_start[index])
-                > size_from_index(index)))
+        if (!in_size_class(get_size(free_list_start[index]), index))
+        {
+            return false;
+        }
+        if (!get_list_bit(index))
         {
-
             return false;
         }
 
-        for(check_list = free_list_start[index] -> next; 
-            check_list != NULL && check_list != free_list_start[index]; 
-            check_list = check_list -> next)
+        for(check_list = get_link(start -> next); 
+            check_list != NULL && check_list != start; 
+            check_list = get_link(check_list -> next))
         {
-            if(check_list -> prev -> next != check_list)
+            if(get_link(get_link(check_list -> prev) -> next) != check_list)
             {
                 return false;
             }
-            if(check_list -> next -> prev != check_list)
+            if(get_link(get_link(check_list -> next) -> prev) != check_list)
             {
                 return false;
             }
@@ -602,15 +2687,91 @@ bool check_free_list()
             {
                 return false;
             }
-            if (index != 15 && 
-                get_size(check_list)
-                     > size_from_index(index))
+            if (!in_size_class(get_size(check_list), index))
+            {
+                return false;
+            }
+            if (placement_policy == PLACEMENT_ADDRESS_ORDERED
+                && check_list < get_link(check_list -> prev))
             {
                 return false;
             }
         }
     }
-    return true;
+
+    /* The mini list holds only free mini blocks inside the heap, each
+     * header linking back to the block before it in the list */
+    block_t *mini_prev = NULL;
+    for(check_list = mini_free_list; check_list != NULL;
+        check_list = get_link(check_list -> next))
+    {
+        if((void *)check_list > mem_heap_hi()
+            || (void *)check_list < mem_heap_lo())
+        {
+            return false;
+        }
+        if(get_alloc(check_list) || get_size(check_list) != min_block_size)
+        {
+            return false;
+        }
+        void *prev_bp = (void *)(word_t)(check_list -> header & size_mask);
+        if(prev_bp != (mini_prev == NULL ? NULL : 
+            header_to_payload(mini_prev)))
+        {
+            return false;
+        }
+        mini_prev = check_list;
+    }
+
+    /* The wilderness is the free block before the epilogue, if that is
+     * not a mini block */
+    block_t *epilogue = (block_t *)((char *)mem_heap_hi() + 1 - hsize);
+    block_t *last = get_prev_alloc(epilogue) ? NULL : find_prev(epilogue);
+    if(last != NULL && is_mini(get_size(last)))
+    {
+        last = NULL;
+    }
+    if(wilderness != last)
+    {
+        return false;
+    }
+
+    int tree_count = 0;
+    return check_tree(free_tree, NULL, NULL, NULL, &tree_count);
+}
+
+/* Checks the subtree at node: parent links, (size, address) order between
+ * the blocks low and high (NULL for unbounded), priority order, and that
+ * every node is a free block above tree_min. Adds its size to *count.
+ */
+bool check_tree(block_t *node, block_t *parent, block_t *low, block_t *high,
+                int *count)
+{
+    if(node == NULL)
+    {
+        return true;
+    }
+    if((void *)node > mem_heap_hi() || (void *)node < mem_heap_lo())
+    {
+        return false;
+    }
+    if(get_link(node -> parent) != parent || get_alloc(node)
+        || get_size(node) <= tree_min)
+    {
+        return false;
+    }
+    if((low != NULL && !tree_less(low, node))
+        || (high != NULL && !tree_less(node, high)))
+    {
+        return false;
+    }
+    if(parent != NULL && tree_priority(node) > tree_priority(parent))
+    {
+        return false;
+    }
+    (*count)++;
+    return check_tree(get_link(node -> child[0]), node, low, node, count)
+        && check_tree(get_link(node -> child[1]), node, node, high, count);
 }
 
 /* Counts free blocks by iterating through every block and traversing free list 
@@ -628,7 +2789,7 @@ bool check_heap()
 {
     /* Count free blocks on heap */
     int num_free_heap = 0;
-    for(block_t *block = heap_start; block -> header != 1 ; 
+    for(block_t *block = heap_start; get_size(block) > 0 ; 
             block = find_next(block))
     {
         if(get_size(block) > 0 && (!get_alloc(block)))
@@ -636,9 +2797,29 @@ bool check_heap()
             num_free_heap++;
         }
 
+        /* The next block must agree on whether this one is allocated,
+         * and on whether it is a mini block */
+        if(get_prev_alloc(find_next(block)) != get_alloc(block))
+        {
+            return false;
+        }
+        if(get_prev_mini(find_next(block)) != 
+            is_mini(get_size(block)))
+        {
+            return false;
+        }
+
         if((!get_alloc(block))) 
         {
-            if(get_alloc(find_next(block)) || (get_alloc(find_prev(block))))
+            /* Free blocks other than mini blocks carry a footer
+             * matching their header */
+            if(!is_mini(get_size(block)) &&
+                *find_prev_footer(find_next(block)) != 
+                pack(get_size(block), false, false, false))
+            {
+                return false;
+            }
+            if(get_alloc(find_next(block)) || get_prev_alloc(block))
             {
                 assert(true);
             }
@@ -663,22 +2844,183 @@ bool check_heap()
         {
             num_free_list++;
         }
-        for(check_list = free_list_start[index] -> next; 
-            check_list != NULL && check_list != free_list_start[index]; 
-            check_list = check_list -> next)
+        for(check_list = get_link(free_list_start[index] -> next); 
+            check_list != NULL && check_list != free_list_start[index]; 
+            check_list = get_link(check_list -> next))
+        {
+            num_free_list++;
+        }
+    }
+
+    for(check_list = mini_free_list; check_list != NULL;
+        check_list = get_link(check_list -> next))
+    {
+        num_free_list++;
+    }
+    if(wilderness != NULL)
+    {
+        num_free_list++;
+    }
+    if(!check_tree(free_tree, NULL, NULL, NULL, &num_free_list))
+    {
+        return false;
+    }
+
+    /* Adjustment for some small uncoalased blocks by design */
+    return(num_free_list - num_free_heap <= 1);
+}
+
+/* Checks that every quick bin holds allocated blocks of its size inside
+ * the heap, and that their sizes add up to quick_bytes.
+ */
+bool check_quick_bins()
+{
+    size_t total = 0;
+
+    for(size_t bin = 0; bin < NUM_QUICK_BINS; bin++)
+    {
+        for(block_t *block = quick_bins[bin]; block != NULL;
+            block = get_link(block -> next))
+        {
+            if((void *)block > mem_heap_hi() || (void *)block < mem_heap_lo())
+            {
+                return false;
+            }
+            if(!get_alloc(block) || get_size(block) != (bin + 1) * dsize)
+            {
+                return false;
+            }
+            total += get_size(block);
+        }
+    }
+    return total == quick_bytes;
+}
+
+/* Checks that zero_start lies in the last block when it is free, or at
+ * the epilogue when it is allocated, and that the last block's payload is
+ * zero from zero_start on, bar its links and footer.
+ */
+bool check_zero_tail()
+{
+    block_t *epilogue = (block_t *)((char *)mem_heap_hi() + 1 - hsize);
+    if(get_prev_alloc(epilogue))
+    {
+        return zero_start == (char *)epilogue;
+    }
+
+    block_t *last = find_prev(epilogue);
+    if(zero_start < (char *)last || zero_start > (char *)epilogue)
+    {
+        return false;
+    }
+    char *from = (char *)last + sizeof(block_t);
+    from = from > zero_start ? from : zero_start;
+    for(hword_t *word = (hword_t *)from; (char *)(word + 1) < (char *)epilogue;
+        word++)
+    {
+        if(*word != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Checks that every live handle holds the payload of an allocated block,
+ * in the heap or mapped but never in a run, that num_handles counts
+ * them, and that the handles a compaction pass has yet to move are live
+ * and know their index in compact_order.
+ */
+bool check_handles()
+{
+    size_t live = 0;
+
+    for(handle_page_t *page = handle_pages; page != NULL; page = page -> next)
+    {
+        for(size_t i = 0; i < page -> used; i++)
+        {
+            void *bp = page -> handles[i].ptr;
+            if(bp == NULL)
+            {
+                continue;
+            }
+            live++;
+            if(find_run(bp) != NULL)
+            {
+                return false;
+            }
+            block_t *block = payload_to_header(bp);
+            if(bp > mem_heap_hi() || bp < mem_heap_lo())
+            {
+                if(!is_mapped(block))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if(!get_alloc(block) || is_mapped(block))
+            {
+                return false;
+            }
+        }
+    }
+    for(size_t i = compact_next; compact_order != NULL && i < compact_count;
+        i++)
+    {
+        if(compact_order[i] != NULL && (compact_order[i] -> ptr == NULL
+                                        || compact_order[i] -> order != i))
         {
-            num_free_list++;
+            return false;
         }
     }
-
-    /* Adjustment for some small uncoalased blocks by design */
-    return(num_free_list - num_free_heap <= 1);
+    return live == num_handles;
 }
 
 /* Checks epilogue and prologue blocks */
 bool check_bounds()
 {
-    return (*(word_t*)((&(heap_start -> header)) - 1) == 1);
+    return (*((&(heap_start -> header)) - 1) == 1);
+}
+
+/* Checks the following:
+* - Every run on a partial list is marked with its class in page_map, is
+*   an allocated run_size block, and has a free slot,
+* - Its used count matches its used_map.
+*/
+bool check_runs()
+{
+    for(size_t slab_class = 0; slab_class < NUM_SLAB_CLASSES; slab_class++)
+    {
+        for(run_t *run = partial_runs[slab_class]; run != NULL;
+            run = run -> next)
+        {
+            block_t *block = payload_to_header(run);
+            size_t used = 0;
+
+            if(find_run(run) != run || run -> slab_class != slab_class
+                || *find_page_entry(run, false) != slab_class + 1)
+            {
+                return false;
+            }
+            if(!get_alloc(block) || get_size(block) != run_size)
+            {
+                return false;
+            }
+            if(run -> used >= run -> capacity)
+            {
+                return false;
+            }
+            for(size_t slot = 0; slot < run -> capacity; slot++)
+            {
+                used += (run -> used_map[slot / 64] >> (slot % 64)) & 1;
+            }
+            if(used != run -> used)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 /* Heap checker does that following:
@@ -689,8 +3031,12 @@ bool check_bounds()
  * - Check each block’s header and footer:
  * - Check each block’s address alignment.
  * - Checks heap bounderies
+ * - Checks the runs small requests are served from
+ * - Checks the quick bins
+ * - Checks that the end of the heap is zero past zero_start
+ * - Checks that each live handle holds an allocated block
 
- * It uses three helper functions. Their documentation is provided where they 
+ * It uses seven helper functions. Their documentation is provided where they 
  * are written.
  */
 bool mm_checkheap(int line)  
@@ -713,152 +3059,505 @@ bool mm_checkheap(int line)
         printf("Caller @line %d\n", line);
         return false;
     }
+    if(!check_runs())
+    {
+        printf("HEAP CHECK FAILED ON RUNS. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
+    if(!check_quick_bins())
+    {
+        printf("HEAP CHECK FAILED ON QUICK BINS. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
+    if(!check_zero_tail())
+    {
+        printf("HEAP CHECK FAILED ON ZERO TAIL. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
+    if(!check_handles())
+    {
+        printf("HEAP CHECK FAILED ON HANDLES. ");
+        printf("Caller @line %d\n", line);
+        return false;
+    }
     return true;
 }
 
 /* Takes in index of a list and returns appropriate size class */
 static size_t size_from_index(size_t index)
 {
-    size_t size = 0;
+    return list_bounds[index];
+}
 
-    if(index == 0)
+/* Takes in a block size and a list index and returns whether blocks of
+ * that size belong in that list, i.e. lie above the previous list's bound
+ * and within this one's.
+ */
+static bool in_size_class(size_t size, size_t index)
+{
+    if (size > size_from_index(index))
     {
-        size = 32;
+        return false;
     }
-    else if(index == 1)
+    return index == 0 || size > size_from_index(index - 1);
+}
+
+/*
+ * Fills list_bounds from the class_specs entry for NUM_LISTS: dsize steps
+ * from the smallest listed block up to exact_max, then (1 << sub_shift)
+ * equal steps per power of two. The last list takes everything larger.
+ */
+static void build_size_classes(void)
+{
+    const class_spec_t *spec = &class_specs[find_first_set(NUM_LISTS) - 4];
+    size_t bound = 2*dsize; // smallest block kept on a list (not mini)
+
+    dbg_requires((NUM_LISTS & (NUM_LISTS - 1)) == 0);
+    for(size_t index = 0; index < NUM_LISTS - 1; index++)
     {
-        size = 64;
+        list_bounds[index] = bound;
+        if (bound < spec -> exact_max)
+        {
+            bound += dsize;
+        }
+        else
+        {
+            size_t power = (size_t)1 << (63 - __builtin_clzll(bound));
+            bound += power >> spec -> sub_shift;
+        }
     }
-    else if(index == 2)
+    list_bounds[NUM_LISTS - 1] = (size_t)-1;
+    tree_index = find_best_index(tree_min + 1);
+    dbg_ensures(list_bounds[tree_index - 1] == tree_min);
+}
+
+/*
+ * Takes in size of a block and returns appropriate free list index.
+ * This is a branch-free binary search over list_bounds: each step adds
+ * the result of a comparison instead of branching on it, so the lookup
+ * costs log2(NUM_LISTS) loads and no mispredictions. It counts the bounds
+ * below asize, which is the first list whose bound is at least asize.
+ */
+static size_t find_best_index(size_t asize)
+{
+    size_t index = 0;
+    for(size_t step = NUM_LISTS / 2; step > 0; step /= 2)
     {
-        size = 161;
+        index += (size_t)(list_bounds[index + step - 1] < asize) * step;
     }
-    else if(index == 3)
+    return index;
+}
+
+/* Marks list index as non-empty or empty in free_list_bitmap */
+static void set_list_bit(size_t index, bool nonempty)
+{
+    word_t bit = (word_t)1 << (index % 64);
+    if (nonempty)
     {
-        size = 200;
+        free_list_bitmap[index / 64] |= bit;
     }
-    else if(index == 4)
+    else
     {
-        size = 290;
+        free_list_bitmap[index / 64] &= ~bit;
     }
-    else if(index == 5)
+}
+
+/* Returns whether list index is marked non-empty in free_list_bitmap */
+static bool get_list_bit(size_t index)
+{
+    return (free_list_bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+/* qsort comparator ordering an array of pointers by address */
+static int compare_addresses(const void *a, const void *b)
+{
+    const char *pa = *(const char * const *)a;
+    const char *pb = *(const char * const *)b;
+    return (pa > pb) - (pa < pb);
+}
+
+/*
+ * Takes in an array of n handles and sorts it by their objects' address
+ * with a heapsort. compact_order is in a mapped region, which the
+ * emulated driver only reaches through mm.c's own loads and stores, so
+ * it cannot go to qsort.
+ */
+static void sort_handles(mm_handle_t **order, size_t n)
+{
+    for (size_t i = n / 2; i > 0; i--)
     {
-        size = 350;
+        sift_handle(order, i - 1, n);
     }
-    else if(index == 6)
+    for (size_t end = n; end > 1; end--)
     {
-        size = 550;
+        mm_handle_t *last = order[0];
+        order[0] = order[end - 1];
+        order[end - 1] = last;
+        sift_handle(order, 0, end - 1);
     }
-    else if(index == 7)
+}
+
+/*
+ * Takes in a max-heap of n handles, keyed by their objects' address,
+ * that may be out of order only at i, and sifts the handle at i down to
+ * its place
+ */
+static void sift_handle(mm_handle_t **order, size_t i, size_t n)
+{
+    mm_handle_t *handle = order[i];
+    size_t child = 2 * i + 1;
+    while (child < n)
     {
-        size = 760;
+        if (child + 1 < n && (char *)order[child + 1] -> ptr
+            > (char *)order[child] -> ptr)
+        {
+            child++;
+        }
+        if ((char *)order[child] -> ptr <= (char *)handle -> ptr)
+        {
+            break;
+        }
+        order[i] = order[child];
+        i = child;
+        child = 2 * i + 1;
     }
-    else if(index == 8)
+    order[i] = handle;
+}
+
+/*
+ * Takes in a pool and allocates it a new chunk to carve slots from,
+ * dropping what was left of the last one. Returns false if no chunk
+ * could be allocated.
+ */
+static bool pool_grow(mm_pool_t *pool)
+{
+    char *chunk = malloc(pool -> chunk_size);
+    if (chunk == NULL)
     {
-        size = 1100;
+        return false;
     }
-    else if(index == 9)
+
+    *(void **)chunk = pool -> chunks;
+    pool -> chunks = chunk;
+    pool -> bump = chunk + dsize;
+    pool -> bump_end = chunk + get_usable_size(chunk);
+    if (2 * pool -> chunk_size <= pool_chunk_max)
     {
-        size = 4140;
+        pool -> chunk_size *= 2;
     }
-    else if(index == 10)
+    return true;
+}
+
+/*
+ * Takes in an arena and a size over arena_large, and returns a payload of
+ * that size in a chunk of its own, or NULL. The chunk is linked in behind
+ * the one being carved, which stays first.
+ */
+static void *arena_alloc_large(mm_arena_t *arena, size_t size)
+{
+    if (size > (size_t)-1 - dsize)
     {
-        size = 8240;
+        return NULL;
     }
-    else if(index == 11)
+    char *chunk = malloc(dsize + size);
+    if (chunk == NULL)
     {
-        size = 16433;
+        return NULL;
     }
-    else if(index == 12)
+
+    if (arena -> chunks == NULL)
     {
-        size = 34033;
+        *(void **)chunk = NULL;
+        arena -> chunks = chunk;
     }
-    else if(index == 13)
+    else
     {
-        size = 31033;
+        *(void **)chunk = *(void **)arena -> chunks;
+        *(void **)arena -> chunks = chunk;
     }
-    else if(index == 14)
+    return chunk + dsize;
+}
+
+/*
+ * Returns a handle off free_handles, or else one never used from the
+ * newest handle page, mapping a new page when that one is full. Returns
+ * NULL if no page could be mapped.
+ */
+static mm_handle_t *new_handle(void)
+{
+    mm_handle_t *handle = free_handles;
+    if (handle != NULL)
     {
-        size = 62033;
+        free_handles = handle -> next_free;
+        return handle;
     }
-    else
+
+    size_t capacity = (mem_pagesize() - sizeof(handle_page_t))
+                      / sizeof(mm_handle_t);
+    handle_page_t *page = handle_pages;
+    if (page == NULL || page -> used == capacity)
     {
-        size = 0;
+        page = (handle_page_t *)mem_map(mem_pagesize());
+        if (page == NULL)
+        {
+            return NULL;
+        }
+        page -> next = handle_pages;
+        page -> used = 0;
+        handle_pages = page;
     }
-    return size;
+    return &page -> handles[page -> used++];
 }
 
-/* Takes in size of a block and returns appropriate free list index */
-static size_t find_best_index(size_t asize)
+/*
+ * Starts a compaction pass (see mm_hcompact): the quick bins are merged
+ * back so that their blocks count as free, and the live handles are put
+ * in compact_order by address. With no live handles, or if no region
+ * could be mapped for the order, the pass has nothing to move.
+ */
+static void begin_compaction(void)
 {
-    size_t index = 0;
-    if(asize == 32)
+    if (quick_bytes > 0)
+    {
+        consolidate_quick_bins();
+    }
+    compact_count = 0;
+    compact_next = 0;
+    if (num_handles == 0)
+    {
+        return;
+    }
+
+    compact_order = (mm_handle_t **)mem_map(round_up(
+        num_handles * sizeof(mm_handle_t *), mem_pagesize()));
+    if (compact_order == NULL)
+    {
+        return;
+    }
+    for (handle_page_t *page = handle_pages; page != NULL;
+         page = page -> next)
+    {
+        for (size_t i = 0; i < page -> used; i++)
+        {
+            if (page -> handles[i].ptr != NULL)
+            {
+                compact_order[compact_count++] = &page -> handles[i];
+            }
+        }
+    }
+    sort_handles(compact_order, compact_count);
+    for (size_t i = 0; i < compact_count; i++)
     {
-        index = 0;
+        compact_order[i] -> order = i;
     }
-    else if(asize <= 64)
+}
+
+/*
+ * Takes in a handle from compact_order and moves its object lower in the
+ * heap if it can (see mm_hcompact). Returns the payload bytes copied,
+ * which is 0 if the handle was freed (NULL), is locked, or its object is
+ * mapped or has nowhere lower to go.
+ */
+static size_t move_handle(mm_handle_t *handle)
+{
+    if (handle == NULL || handle -> locks > 0)
     {
-        index = 1;
+        return 0;
     }
-    else if(asize <= 161)
+    block_t *block = payload_to_header(handle -> ptr);
+    if (is_mapped(block))
     {
-        index = 2;
+        return 0;
     }
-    else if(asize <= 200)
+
+    size_t size = get_size(block);
+    size_t payload_size = get_payload_size(block);
+    block_t *dest;
+    if (!get_prev_alloc(block))
     {
-        index = 3;
+        // As in resize_in_place: take in the free block below, slide the
+        // payload down and split what is left off the top
+        dest = find_prev(block);
+        size_t prev_size = get_size(dest);
+
+        remove_free_block(dest);
+        write_header(dest, prev_size + size, true, get_prev_alloc(dest),
+                     get_prev_mini(dest));
+        memmove(header_to_payload(dest), handle -> ptr, payload_size);
+        write_next_prev_bits(dest);
+        mark_dirty(dest);
+        split_allocated(dest, size);
     }
-    else if(asize <= 290)
+    else
     {
-        index = 4;
+        dest = find_seg_fit(size);
+        if (dest == NULL || dest > block)
+        {
+            return 0;
+        }
+        place(dest, size);
+        memcpy(header_to_payload(dest), handle -> ptr, payload_size);
+        // Freed for real, not into a quick bin, so the space can merge
+        write_header(block, size, false, get_prev_alloc(block),
+                     get_prev_mini(block));
+        write_footer(block, size);
+        coalesce(block);
     }
-    else if(asize <= 350)
+    handle -> ptr = header_to_payload(dest);
+    return payload_size;
+}
+
+/* Takes in a non-zero bitmap and returns the index of its lowest set bit */
+static size_t find_first_set(word_t bits)
+{
+    dbg_requires(bits != 0);
+    return (size_t)__builtin_ctzll(bits);
+}
+
+/*
+ * Takes in a free block above tree_min and adds it to free_tree: it goes
+ * in as a leaf at its (size, address) position, then rotates up past
+ * every ancestor of lower priority.
+ */
+static void tree_insert(block_t *block)
+{
+    block_t *parent = NULL;
+    block_t *node = free_tree;
+    bool side = false;
+
+    while (node != NULL)
     {
-        index = 5;
+        parent = node;
+        side = tree_less(parent, block);
+        node = get_link(parent -> child[side]);
     }
-    else if(asize <= 550)
+    block -> child[0] = make_link(NULL);
+    block -> child[1] = make_link(NULL);
+    block -> parent = make_link(parent);
+    if (parent == NULL)
     {
-        index = 6;
+        free_tree = block;
     }
-    else if(asize <= 760)
+    else
     {
-        index = 7;
+        parent -> child[side] = make_link(block);
     }
-    else if(asize <= 1100)
+
+    while (block -> parent != make_link(NULL)
+           && tree_priority(block) > tree_priority(get_link(block -> parent)))
     {
-        index = 8;
+        tree_rotate_up(block);
     }
-    else if(asize <= 4140)
+    set_list_bit(tree_index, true);
+}
+
+/*
+ * Takes in a block in free_tree and removes it: while it has two children
+ * the one of higher priority is rotated above it, then its one remaining
+ * child (if any) takes its place.
+ */
+static void tree_remove(block_t *block)
+{
+    while (get_link(block -> child[0]) != NULL
+           && get_link(block -> child[1]) != NULL)
     {
-        index = 9;
+        bool right = tree_priority(get_link(block -> child[1]))
+                     > tree_priority(get_link(block -> child[0]));
+        tree_rotate_up(get_link(block -> child[right]));
     }
-    else if(asize <= 8240)
+
+    block_t *child = get_link(block -> child[get_link(block -> child[0])
+                                             == NULL]);
+    if (child != NULL)
     {
-        index = 10;
+        child -> parent = block -> parent;
     }
-    else if(asize <= 16433)
+    tree_replace_child(get_link(block -> parent), block, child);
+    if (free_tree == NULL)
     {
-        index = 11;
+        set_list_bit(tree_index, false);
     }
-    else if(asize <= 24033)
+}
+
+/*
+ * Takes in an adjusted size and returns the smallest block in free_tree
+ * of at least that size (the lowest address among equals), or NULL.
+ */
+static block_t *tree_find_fit(size_t asize)
+{
+    block_t *fit = NULL;
+    block_t *node = free_tree;
+
+    while (node != NULL)
     {
-        index = 12;
+        if (get_size(node) >= asize)
+        {
+            fit = node;
+            node = get_link(node -> child[0]);
+        }
+        else
+        {
+            node = get_link(node -> child[1]);
+        }
     }
-    else if(asize <= 31033)
+    return fit;
+}
+
+/* Takes in a non-root tree node and rotates it above its parent */
+static void tree_rotate_up(block_t *node)
+{
+    block_t *parent = get_link(node -> parent);
+    size_t side = (get_link(parent -> child[1]) == node);
+    block_t *moved = get_link(node -> child[!side]);
+
+    parent -> child[side] = make_link(moved);
+    if (moved != NULL)
     {
-        index = 13;
+        moved -> parent = make_link(parent);
     }
-    else if(asize <= 62033)
+    node -> parent = parent -> parent;
+    tree_replace_child(get_link(parent -> parent), parent, node);
+    node -> child[!side] = make_link(parent);
+    parent -> parent = make_link(node);
+}
+
+/* Makes new_child take old_child's place under parent, or as the root */
+static void tree_replace_child(block_t *parent, block_t *old_child,
+                               block_t *new_child)
+{
+    if (parent == NULL)
     {
-        index = 14;
+        free_tree = new_child;
     }
     else
     {
-        index = 15;
+        parent -> child[get_link(parent -> child[1]) == old_child]
+            = make_link(new_child);
     }
-    return index;
 }
 
+/* Returns whether block a orders before block b by (size, address) */
+static bool tree_less(block_t *a, block_t *b)
+{
+    size_t size_a = get_size(a);
+    size_t size_b = get_size(b);
+    return size_a < size_b || (size_a == size_b && a < b);
+}
+
+/* Returns the treap priority of a block: its address, mixed so that blocks
+ * allocated in address order still give a tree of expected log depth.
+ */
+static word_t tree_priority(block_t *block)
+{
+    word_t key = (word_t)block;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
 
 /*
  *****************************************************************************
@@ -909,23 +3608,47 @@ static size_t round_up(size_t size, size_t n)
 /*
  * pack: returns a header reflecting a specified size and its alloc status.
  *       If the block is allocated, the lowest bit is set to 1, and 0 otherwise.
+ *       If the previous block is allocated, the second bit is set to 1.
+ *       If the previous block is a mini block, the third bit is set to 1.
  */
-static word_t pack(size_t size, bool alloc)
+static hword_t pack(size_t size, bool alloc, bool prev_alloc, bool prev_mini)
 {
   
-    word_t w = alloc ? (size | alloc_mask) : size;
+    hword_t w = alloc ? (size | alloc_mask) : size;
+    if (prev_alloc)
+    {
+        w |= prev_alloc_mask;
+    }
+    if (prev_mini)
+    {
+        w |= prev_mini_mask;
+    }
    
     return w;
 
 }
 
+/*
+ * is_mini: returns whether a block of this size is a mini block, too small
+ *          for a footer once free. There are none with COMPACT.
+ */
+static bool is_mini(size_t size)
+{
+    return size == min_block_size && 2*hsize + 2*sizeof(link_t) > size;
+}
+
 
 /*
  * extract_size: returns the size of a given header value based on the header
- *               specification above.
+ *               specification above. A free mini block header stores a
+ *               link where the size would be, so its size is implied.
  */
-static size_t extract_size(word_t word)
+static size_t extract_size(hword_t word)
 {
+    if (word & mini_free_mask)
+    {
+        return min_block_size;
+    }
     return (word & size_mask);
 }
 
@@ -940,20 +3663,20 @@ static size_t get_size(block_t *block)
 }
 
 /*
- * get_payload_size: returns the payload size of a given block, equal to
- *                   the entire block size minus the header and footer sizes.
+ * get_payload_size: returns the payload size of a given allocated block,
+ *                   equal to the entire block size minus the header size.
  */
 static word_t get_payload_size(block_t *block)
 {
     size_t asize = get_size(block);
-    return asize - dsize;
+    return asize - hsize;
 }
 
 /*
  * extract_alloc: returns the allocation status of a given header value based
  *                on the header specification above.
  */
-static bool extract_alloc(word_t word)
+static bool extract_alloc(hword_t word)
 {
     return (bool)(word & alloc_mask);
 }
@@ -968,26 +3691,65 @@ static bool get_alloc(block_t *block)
 }
 
 /*
- * write_header: given a block and its size and allocation status,
- *               writes an appropriate value to the block header.
+ * get_prev_alloc: returns true when the block before this one is allocated,
+ *                 based on the second lowest bit of the block header.
+ */
+static bool get_prev_alloc(block_t *block)
+{
+    return (bool)(block->header & prev_alloc_mask);
+}
+
+/*
+ * get_prev_mini: returns true when the block before this one is a mini
+ *                block, based on the third lowest bit of the block header.
+ */
+static bool get_prev_mini(block_t *block)
+{
+    return (bool)(block->header & prev_mini_mask);
+}
+
+/*
+ * write_header: given a block, its size, its allocation status and the
+ *               status and kind of the previous block, writes an
+ *               appropriate value to the block header.
  */
-static void write_header(block_t *block, size_t size, bool alloc)
+static void write_header(block_t *block, size_t size, bool alloc,
+                         bool prev_alloc, bool prev_mini)
 {
     
-    block->header = pack(size, alloc);
+    block->header = pack(size, alloc, prev_alloc, prev_mini);
   
 }
 
 
 /*
- * write_footer: given a block and its size and allocation status,
- *               writes an appropriate value to the block footer by first
- *               computing the position of the footer.
+ * write_footer: given a free block and its size, writes an appropriate
+ *               value to the block footer by first computing the position
+ *               of the footer. Allocated blocks and mini blocks have no
+ *               footer.
+ */
+static void write_footer(block_t *block, size_t size)
+{
+    if (is_mini(size))
+    {
+        return;
+    }
+    hword_t *footerp = (hword_t *)((char *)block + get_size(block) - hsize);
+    *footerp = pack(size, false, false, false);
+}
+
+/*
+ * write_next_prev_bits: records in the header of the block after this one
+ *                       whether this block is allocated and whether it is
+ *                       a mini block, leaving the rest of it untouched.
  */
-static void write_footer(block_t *block, size_t size, bool alloc)
+static void write_next_prev_bits(block_t *block)
 {
-    word_t *footerp = (word_t *)((block->payload) + get_size(block) - dsize);
-    *footerp = pack(size, alloc);
+    block_t *block_next = find_next(block);
+    hword_t header = block_next->header & ~(prev_alloc_mask | prev_mini_mask);
+
+    block_next->header = header | pack(0, false, get_alloc(block),
+                                       is_mini(get_size(block)));
 }
 
 
@@ -1004,7 +3766,7 @@ static block_t *find_next(block_t *block)
     return block_next;
 }
 
-// static word_t *find_prev_header(block_t *block)
+// static hword_t *find_prev_header(block_t *block)
 // {
 //     // Compute previous footer position as one word before the header
 //     while(true)
@@ -1020,7 +3782,7 @@ static block_t *find_next(block_t *block)
 /*
  * find_prev_footer: returns the footer of the previous block.
  */
-static word_t *find_prev_footer(block_t *block)
+static hword_t *find_prev_footer(block_t *block)
 {
     // Compute previous footer position as one word before the header
     return (&(block->header)) - 1;
@@ -1029,11 +3791,16 @@ static word_t *find_prev_footer(block_t *block)
 /*
  * find_prev: returns the previous block position by checking the previous
  *            block's footer and calculating the start of the previous block
- *            based on its size.
+ *            based on its size. Only valid when the previous block is free.
+ *            A mini block has no footer, but its size is known.
  */
 static block_t *find_prev(block_t *block)
 {
-    word_t *footerp = find_prev_footer(block);
+    if (get_prev_mini(block))
+    {
+        return (block_t *)((char *)block - min_block_size);
+    }
+    hword_t *footerp = find_prev_footer(block);
     size_t size = extract_size(*footerp);
     return (block_t *)((char *)block - size);
 }
@@ -1054,4 +3821,38 @@ static block_t *payload_to_header(void *bp)
 static void *header_to_payload(block_t *block)
 {
     return (void *)(block->payload);
-}
\ No newline at end of file
+}
+
+/*
+ * get_link: given a next, prev, child or parent link of a free block,
+ *           returns the block it points to, or NULL.
+ */
+static block_t *get_link(link_t link)
+{
+#ifdef COMPACT
+    if (link == 0)
+    {
+        return NULL;
+    }
+    return (block_t *)((char *)heap_start + (size_t)(link - 1) * dsize);
+#else
+    return link;
+#endif
+}
+
+/*
+ * make_link: given a block in the heap, or NULL, returns the link to it
+ *            to store in a free block.
+ */
+static link_t make_link(block_t *block)
+{
+#ifdef COMPACT
+    if (block == NULL)
+    {
+        return 0;
+    }
+    return (link_t)((size_t)((char *)block - (char *)heap_start) / dsize + 1);
+#else
+    return block;
+#endif
+}
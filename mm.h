@@ -8,6 +8,9 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
 
 #else
 
@@ -16,10 +19,51 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
 
 #endif
 
 extern bool mm_init(void);
 
+/* Optional entry points, down to mm_checkheap: a backend may leave any of
+ * them out, as mdriver checks for each one before use */
+
+/* Batch entry points: n blocks of one size, and n frees in one sweep */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* free() for a block whose size (as last requested) the caller knows */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* Bytes the payload at ptr can hold, at least the size it was asked for */
+extern size_t mm_usable_size(void *ptr);
+
+/* Pools of objects of one size, carved from heap chunks with no header
+ * per object. mm_pool_destroy frees all of a pool's objects at once */
+typedef struct mm_pool mm_pool_t;
+extern mm_pool_t *mm_pool_create(size_t size);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/* Arenas: bump allocation through heap chunks, all released at once by
+ * mm_arena_reset or mm_arena_destroy */
+typedef struct mm_arena mm_arena_t;
+extern mm_arena_t *mm_arena_create(void);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/* Handles to objects mm_hcompact may move. mm_hlock pins the object and
+ * returns where it is now, until the matching mm_hunlock */
+typedef struct mm_handle mm_handle_t;
+extern mm_handle_t *mm_halloc(size_t size);
+extern void *mm_hlock(mm_handle_t *handle);
+extern void mm_hunlock(mm_handle_t *handle);
+extern void mm_hfree(mm_handle_t *handle);
+extern bool mm_hcompact(size_t budget);
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int lineno);